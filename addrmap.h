@@ -0,0 +1,111 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef ADDRMAP_H_
+#define ADDRMAP_H_
+
+#include <vector>
+#include <string>
+
+#include "inttypes.h"
+#include "object.h"
+#include "memory.h"
+#include "log.h"
+
+/* A device occupying a range of tape addresses. 
+ * Addresses passed are offsets from the start of the mapping. */
+class MappedDeviceIface {
+public:
+    virtual my_uint128_t Read(address_t offset) = 0;
+    virtual void Write(address_t offset, my_uint128_t val) = 0;
+};
+
+/* Tape address space: plain memory with devices mapped over certain ranges.
+ * Addresses outside of [lo, hi) of all mappings cost one comparison 
+ * before going to memory. */
+class AddressMap: public MemoryIface, public SimObject {
+    struct mapping_t {
+        address_t start;
+        address_t length;
+        MappedDeviceIface *dev;
+    };
+    
+    MemoryIface &ram;
+    std::vector<mapping_t> mappings; // sorted by start, not overlapping
+    address_t lo, hi;
+    
+    inline const mapping_t* Lookup(address_t addr) const {
+        if (addr < lo || addr >= hi)
+            return nullptr;
+        for (auto &m: mappings) { // there are few of them
+            if (addr < m.start)
+                return nullptr;
+            if (addr - m.start < m.length)
+                return &m;
+        }
+        return nullptr;
+    }
+
+public:
+    AddressMap(const std::string _name, MemoryIface &_ram): 
+        SimObject(_name), ram(_ram), mappings(), lo(0), hi(0) {};
+    
+    void AddMapping(MappedDeviceIface &dev, address_t start, address_t length) {
+        if (length == 0 || start + length < start)
+            error("Bad mapping range");
+        auto it = mappings.begin();
+        while (it != mappings.end() && it->start < start)
+            it++;
+        if ((it != mappings.end() && start + length > it->start) ||
+            (it != mappings.begin() && (it-1)->start + (it-1)->length > start))
+            error("Mapping overlaps an existing one");
+        mappings.insert(it, {start, length, &dev});
+        lo = mappings.front().start;
+        hi = mappings.back().start + mappings.back().length;
+    }
+    
+    virtual my_uint128_t Read(address_t addr) {
+        const mapping_t *m = Lookup(addr);
+        if (m)
+            return m->dev->Read(addr - m->start);
+        return ram.Read(addr);
+    }
+    
+    virtual void Write(address_t addr, my_uint128_t val) {
+        const mapping_t *m = Lookup(addr);
+        if (m)
+            m->dev->Write(addr - m->start, val);
+        else
+            ram.Write(addr, val);
+    }
+    
+    virtual void LoadRaw(const char* buf, size_t len) { ram.LoadRaw(buf, len); }
+    virtual const char* Dump() const { return ram.Dump(); }
+    virtual size_t Size() const { return ram.Size(); }
+};
+
+#endif // ADDRMAP_H_
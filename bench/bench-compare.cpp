@@ -0,0 +1,127 @@
+// Compares two results of run-suite.sh and fails on significant slowdowns
+// Usage: bench-compare.exe baseline.json current.json [threshold, %]
+// Exit code: 0 - no regressions, 1 - some benchmark is significantly slower
+// by more than threshold, 2 - bad input or a baseline benchmark without
+// results in current.json, e.g. because it crashed.
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+#include "measure.h"
+
+typedef std::map<std::string, std::vector<double>> results_t;
+
+/* Speeds of individual runs per benchmark name. run-suite.sh writes
+ * every benchmark on its own line, which is all this parser handles. */
+static bool load(const char *file, results_t &res) {
+    std::ifstream in(file);
+    if (!in) {
+        std::cerr << "Cannot open " << file << std::endl;
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line)) {
+        const std::string name_key = "\"name\": \"";
+        const std::string runs_key = "\"steps_per_second_runs\": [";
+        size_t n = line.find(name_key);
+        if (n == std::string::npos)
+            continue;
+        n += name_key.size();
+        std::string name = line.substr(n, line.find('"', n) - n);
+        size_t r = line.find(runs_key);
+        if (r == std::string::npos) {
+            std::cerr << file << ": no per-run speeds for " << name << std::endl;
+            return false;
+        }
+        r += runs_key.size();
+        std::string runs = line.substr(r, line.find(']', r) - r);
+        for (char &c: runs)
+            if (c == ',')
+                c = ' ';
+        std::istringstream vals(runs);
+        double v;
+        while (vals >> v)
+            res[name].push_back(v);
+    }
+    return true;
+}
+
+static void mean_var(const std::vector<double> &v, double &mean, double &var) {
+    mean = var = 0;
+    for (double x: v)
+        mean += x;
+    mean /= v.size();
+    for (double x: v)
+        var += (x - mean) * (x - mean);
+    var = v.size() > 1 ? var / (v.size() - 1) : 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        std::cerr << "Usage: " << argv[0] 
+                  << " baseline.json current.json [threshold, %]\n";
+        return 2;
+    }
+    double threshold = argc > 3 ? atof(argv[3]) : 5.0;
+    results_t base, cur;
+    if (!load(argv[1], base) || !load(argv[2], cur))
+        return 2;
+    
+    int regressions = 0, missing = 0;
+    std::cout << std::left << std::setw(16) << "benchmark" << std::right
+              << std::setw(14) << "base steps/s" << std::setw(14) 
+              << "steps/s" << std::setw(10) << "change" << "  verdict\n";
+    for (auto &b: base) {
+        auto c = cur.find(b.first);
+        if (c == cur.end() || c->second.empty() || b.second.empty()) {
+            std::cout << std::left << std::setw(16) << b.first << std::right
+                      << "  MISSING, no runs in "
+                      << (b.second.empty() ? argv[1] : argv[2]) << '\n';
+            missing++;
+            continue;
+        }
+        double bm, bv, cm, cv;
+        mean_var(b.second, bm, bv);
+        mean_var(c->second, cm, cv);
+        double change = bm > 0 ? 100.0 * (cm - bm) / bm : 0;
+        /* Welch's t-test, the variances of runs need not be equal */
+        double sb = bv / b.second.size(), sc = cv / c->second.size();
+        double se = std::sqrt(sb + sc);
+        bool significant;
+        if (se == 0) {
+            significant = cm != bm;
+        } else {
+            double df = (sb + sc) * (sb + sc) / 
+                        ((b.second.size() > 1 ? sb * sb / (b.second.size() - 1) : 0) + 
+                         (c->second.size() > 1 ? sc * sc / (c->second.size() - 1) : 0));
+            /* Round down to stay conservative; the table ends long before
+             * 1000, which also catches infinite df from tiny variances */
+            unsigned d = !(df < 1000) ? 1000 : df < 1 ? 1 : (unsigned)df;
+            significant = std::fabs(cm - bm) / se > t95(d);
+        }
+        const char *verdict = !significant ? "no significant change" :
+                              change > 0 ? "faster" : "slower";
+        if (significant && -change > threshold) {
+            verdict = "REGRESSION";
+            regressions++;
+        }
+        std::cout << std::left << std::setw(16) << b.first << std::right 
+                  << std::setprecision(4) << std::setw(14) << bm 
+                  << std::setw(14) << cm << std::fixed << std::setprecision(1)
+                  << std::setw(9) << change << "%  " << verdict << '\n';
+        std::cout.unsetf(std::ios::fixed);
+    }
+    if (regressions)
+        std::cout << regressions << " benchmark(s) slower by more than " 
+                  << threshold << "%\n";
+    if (missing)
+        std::cout << missing << " benchmark(s) have no results\n";
+    return missing ? 2 : regressions ? 1 : 0;
+}
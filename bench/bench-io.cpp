@@ -0,0 +1,77 @@
+// Benchmark of guest output through IODev and UringIODev
+// Usage: bench-io.exe [guests] [bytes per guest]
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <iostream>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "iodev.h"
+#include "uringio.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static void report(const char *name, unsigned guests, size_t bytes,
+                   bench_clock::time_point start) {
+    double sec = std::chrono::duration<double>(bench_clock::now() - start).count();
+    double total = (double)guests * bytes;
+    std::cout << name << ": " << sec << " s, " 
+              << total / sec / 1e6 << " MB/s, "
+              << sec / total * 1e9 << " ns/byte\n";
+}
+
+/* All guests take turns writing a byte, as a host stepping them would */
+static void bench_iodev(unsigned guests, size_t bytes) {
+    std::vector<std::unique_ptr<IODev>> devs;
+    for (unsigned g = 0; g < guests; g++)
+        devs.emplace_back(new IODev("io", "/dev/null", "/dev/null"));
+    auto start = bench_clock::now();
+    for (size_t i = 0; i < bytes; i++)
+        for (auto &dev: devs)
+            dev->Write(i);
+    for (auto &dev: devs)
+        dev->Flush();
+    report("IODev", guests, bytes, start);
+}
+
+static void bench_uring(unsigned guests, size_t bytes, bool use_uring) {
+    int fd = open("/dev/null", O_RDWR);
+    UringHub hub("hub", guests, 4096, use_uring);
+    if (use_uring && !hub.UsesUring()) {
+        std::cout << "UringIODev: io_uring is not available\n";
+        close(fd);
+        return;
+    }
+    std::vector<std::unique_ptr<UringIODev>> devs;
+    for (unsigned g = 0; g < guests; g++)
+        devs.emplace_back(new UringIODev("io", hub, fd, fd));
+    auto start = bench_clock::now();
+    for (size_t i = 0; i < bytes; i++) {
+        for (auto &dev: devs)
+            dev->Write(i);
+        hub.Poll(); // one submission for everything queued this round
+    }
+    for (auto &dev: devs)
+        dev->Flush();
+    report(use_uring ? (hub.UsesFixedBuffers() ? "UringIODev (fixed buffers)" 
+                                               : "UringIODev") 
+                     : "UringIODev (read/write fallback)", 
+           guests, bytes, start);
+    devs.clear();
+    close(fd);
+}
+
+int main(int argc, char **argv) {
+    unsigned guests = argc > 1 ? atoi(argv[1]) : 256;
+    size_t bytes = argc > 2 ? atol(argv[2]) : 1 << 20;
+    std::cout << guests << " guests, " << bytes << " bytes each\n";
+    bench_iodev(guests, bytes);
+    bench_uring(guests, bytes, true);
+    bench_uring(guests, bytes, false);
+    return 0;
+}
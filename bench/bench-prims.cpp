@@ -0,0 +1,148 @@
+// Microbenchmarks of the building blocks of the interpreter: memories,
+// IO device, configuration and register access
+// Usage: bench-prims.exe [repetitions] [warmup repetitions]
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdlib>
+
+#include "memory.h"
+#include "iodev.h"
+#include "config.h"
+#include "bofsim.h"
+#include "measure.h"
+
+static int reps = 15;
+static int warmup = 3;
+static volatile uint64_t sink; // keeps results alive
+
+/* Runs body, which does ops operations, warmup + reps times and prints
+ * the mean time per operation with its 95% confidence interval */
+template <typename F>
+static void measure(const std::string &name, size_t ops, F body) {
+    std::vector<double> ns = time_runs(reps, warmup, body);
+    for (double &v: ns)
+        v *= 1e9 / ops;
+    measurement_t m = summarize(ns);
+    std::cout << std::left << std::setw(32) << name << std::right 
+              << std::fixed << std::setprecision(3)
+              << std::setw(12) << m.mean << " +- " << std::setw(8) << m.ci 
+              << " ns/op, min " << m.min << '\n';
+}
+
+/* Addresses in [0, range) from a fixed-seed LCG, same every run */
+static std::vector<address_t> random_addresses(size_t count, address_t range) {
+    std::vector<address_t> addrs(count);
+    uint64_t x = 12345;
+    for (auto &a: addrs) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        a = (x >> 17) % range;
+    }
+    return addrs;
+}
+
+static void bench_memory() {
+    const address_t tape_len = 9999; // default configuration
+    const size_t ops = 1 << 20;
+    std::vector<address_t> seq(ops), rnd, sparse;
+    for (size_t i = 0; i < ops; i++)
+        seq[i] = i % tape_len;
+    rnd = random_addresses(ops, tape_len);
+    sparse = random_addresses(ops, 1 << 24);
+    
+    struct pattern_t {
+        const char *name;
+        const std::vector<address_t> &addrs;
+    } patterns[] = { {"sequential", seq}, {"random", rnd}, {"sparse", sparse} };
+    for (auto &p: patterns) {
+        Memory mem("mem");
+        MemoryIface &m = mem; // the interpreter calls through the interface
+        const std::vector<address_t> &addrs = p.addrs;
+        measure(std::string("Memory::Write ") + p.name, ops, [&]() {
+            for (address_t a: addrs)
+                m.Write(a, a);
+        });
+        measure(std::string("Memory::Read ") + p.name, ops, [&]() {
+            uint64_t sum = 0;
+            for (address_t a: addrs)
+                sum += (uint64_t)m.Read(a);
+            sink = sum;
+        });
+    }
+    
+    for (size_t size: {64, 4096, 65536, 1 << 20}) {
+        std::vector<char> buf(size, '+');
+        const size_t loads = std::max<size_t>(1, (64 << 20) / size);
+        Memory mem("mem");
+        measure("Memory::LoadRaw " + std::to_string(size) + " B", loads, [&]() {
+            for (size_t i = 0; i < loads; i++)
+                mem.LoadRaw(buf.data(), size);
+            sink = mem.Size();
+        });
+    }
+}
+
+static void bench_iodev() {
+    const size_t ops = 1 << 22;
+    IODev io("io", "/dev/null", "/dev/null");
+    IOIface &dev = io;
+    measure("IODev::Write", ops, [&]() {
+        for (size_t i = 0; i < ops; i++)
+            dev.Write(i);
+        dev.Flush();
+    });
+}
+
+static void bench_config() {
+    const size_t ops = 1 << 20;
+    Configuration cfg;
+    cfg.cfg = { {"tl", 9999}, {"tw", 8}, {"nm", 3}, {"sd", 16}, {"il", 4096} };
+    const char *keys[] = {"tl", "tw", "nm", "sd", "il"};
+    std::vector<std::string> strkeys(keys, keys + 5);
+    measure("Configuration::Get literal", ops, [&]() {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < ops; i++)
+            sum += (uint64_t)cfg.Get(keys[i % 5]);
+        sink = sum;
+    });
+    measure("Configuration::Get string", ops, [&]() {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < ops; i++)
+            sum += (uint64_t)cfg.Get(strkeys[i % 5]);
+        sink = sum;
+    });
+    
+    Memory tape("tape");
+    Memory acode("ainstr");
+    Memory scode("sinstr");
+    IODev io("io", "/dev/null", "/dev/null");
+    BfCpu cpu("cpu", cfg, tape, acode, scode, io);
+    const RegisterAccessIface &regs = cpu;
+    measure("BfCpu::GetRegs", ops / 16, [&]() {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < ops / 16; i++)
+            sum += (uint64_t)regs.GetRegs().Get("pc");
+        sink = sum;
+    });
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1)
+        reps = atoi(argv[1]);
+    if (argc > 2)
+        warmup = atoi(argv[2]);
+    if (reps < 1 || warmup < 0) {
+        std::cerr << "Usage: " << argv[0] << " [repetitions >= 1]"
+                     " [warmup repetitions >= 0]\n";
+        return 2;
+    }
+    std::cout << reps << " repetitions after " << warmup 
+              << " warmup ones, mean with 95% confidence interval\n";
+    bench_memory();
+    bench_iodev();
+    bench_config();
+    return 0;
+}
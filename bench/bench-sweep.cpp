@@ -0,0 +1,110 @@
+// Simulation speed of synthetic workloads as each of their properties
+// is swept while the others stay at defaults, for every engine
+// Usage: bench-sweep.exe [steps per point] [CSV output file] [repetitions]
+//                        [warmup repetitions]
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdlib>
+
+#include "diffexec.h"
+#include "progen.h"
+#include "measure.h"
+
+struct sweep_t {
+    const char *name;
+    std::vector<double> values;
+    void (*apply)(workload_params_t &w, double v);
+};
+
+int main(int argc, char **argv) {
+    step_t steps = argc > 1 ? atol(argv[1]) : 1000000;
+    int reps = argc > 3 ? atoi(argv[3]) : 5;
+    int warmup = argc > 4 ? atoi(argv[4]) : 1;
+    if (reps < 1 || warmup < 0) {
+        std::cerr << "Usage: " << argv[0] << " [steps per point] [CSV file]"
+                     " [repetitions >= 1] [warmup repetitions >= 0]\n";
+        return 2;
+    }
+    std::ofstream csv;
+    if (argc > 2 && *argv[2]) {
+        csv.open(argv[2], std::ios::out | std::ios::trunc);
+        csv << "parameter,value,engine,steps_per_second,ci_steps_per_second"
+               "\n";
+    }
+    
+    const sweep_t sweeps[] = {
+        {"depth", {1, 2, 4, 8, 15}, 
+            [](workload_params_t &w, double v) { w.depth = v; }},
+        {"footprint", {0, 0.01, 0.1, 0.5, 0.9}, 
+            [](workload_params_t &w, double v) { w.footprint = v; }},
+        {"skipped", {0, 0.25, 0.5, 0.75, 0.9}, 
+            [](workload_params_t &w, double v) { w.skipped = v; }},
+        {"comments", {0, 0.25, 0.5, 0.75, 0.9}, 
+            [](workload_params_t &w, double v) { w.comments = v; }},
+        {"io", {0, 0.1, 0.25, 0.5, 1}, 
+            [](workload_params_t &w, double v) { w.io = v; }},
+        {"violations", {0, 0.01, 0.05, 0.1, 0.25}, 
+            [](workload_params_t &w, double v) { w.violations = v; }},
+    };
+    std::vector<std::unique_ptr<EngineIface>> engines;
+    engines.emplace_back(new StepEngine());
+    engines.emplace_back(new BatchEngine());
+    
+    std::cout << steps << " steps per point, " << reps 
+              << " repetitions after " << warmup << " warmup ones, "
+              << "mean Msteps/s with 95% confidence interval\n";
+    for (auto &sweep: sweeps) {
+        struct point_t {
+            double value;
+            std::string engine;
+            measurement_t mips;
+            step_t done;
+        };
+        std::vector<point_t> points;
+        double fastest = 0;
+        for (double v: sweep.values) {
+            workload_params_t w;
+            sweep.apply(w, v);
+            WorkloadGenerator gen("workload");
+            random_program_t p = gen.Generate(w);
+            for (auto &e: engines) {
+                step_t done = 0;
+                std::vector<double> rates = time_runs(reps, warmup, [&]() {
+                    DiffMachine m("m", p);
+                    done = e->Run(m, steps);
+                });
+                for (double &r: rates)
+                    r = done / r / 1e6;
+                points.push_back({v, e->Name(), summarize(rates), done});
+                fastest = std::max(fastest, points.back().mips.mean);
+            }
+        }
+        /* Bars are relative to the fastest point of the sweep */
+        std::cout << '\n' << sweep.name << '\n';
+        for (auto &pt: points) {
+            std::cout << std::setw(8) << pt.value << ' ' << std::setw(6) 
+                      << pt.engine << std::fixed << std::setprecision(2)
+                      << std::setw(8) << pt.mips.mean << " +- " 
+                      << std::setw(5) << pt.mips.ci << ' '
+                      << std::string((size_t)(50 * pt.mips.mean / fastest), 
+                                     '#') 
+                      << '\n';
+            std::cout.unsetf(std::ios::fixed);
+            std::cout << std::setprecision(6);
+            if (pt.done < steps)
+                std::cout << "         stopped after " << pt.done 
+                          << " steps\n";
+            if (csv.is_open())
+                csv << sweep.name << ',' << pt.value << ',' << pt.engine 
+                    << ',' << pt.mips.mean * 1e6 << ',' 
+                    << pt.mips.ci * 1e6 << '\n';
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,418 @@
+#!/usr/bin/env python3
+# Generates the larger guest programs of progs/ that are impractical to
+# write by hand: a Mandelbrot set renderer and a Towers of Hanoi solver.
+# Both only use 8-bit cells, so that they run with the default TW. They
+# are longer than the default IL; progs/<name>.opts raises it.
+# Usage: gen-progs.py [output directory]
+
+import os
+import sys
+
+
+class Assembler:
+    """Emits brainfuck for statically allocated cells. The pointer position
+    is tracked at generation time; every construct returns it to where
+    the enclosing loop expects it."""
+
+    def __init__(self):
+        self.code = []
+        self.ptr = 0
+        self.used = set()
+
+    def alloc(self, width=1):
+        """Lowest run of width free cells"""
+        start = 0
+        while any(c in self.used for c in range(start, start + width)):
+            start += 1
+        for c in range(start, start + width):
+            self.used.add(c)
+        return start
+
+    def free(self, cell, width=1):
+        for c in range(cell, cell + width):
+            self.used.discard(c)
+
+    def emit(self, text):
+        self.code.append(text)
+
+    def at(self, cell):
+        delta = cell - self.ptr
+        self.emit('>' * delta if delta > 0 else '<' * -delta)
+        self.ptr = cell
+
+    def add(self, cell, n):
+        n %= 256
+        self.at(cell)
+        self.emit('+' * n if n <= 128 else '-' * (256 - n))
+
+    def clear(self, cell):
+        self.at(cell)
+        self.emit('[-]')
+
+    def set(self, cell, n):
+        self.clear(cell)
+        self.add(cell, n)
+
+    def loop(self, cell, body):
+        self.at(cell)
+        self.emit('[')
+        body()
+        self.at(cell)
+        self.emit(']')
+
+    def move(self, src, *dsts):
+        """Adds src to every dst, src becomes zero"""
+        def body():
+            self.add(src, -1)
+            for d in dsts:
+                self.add(d, 1)
+        self.loop(src, body)
+
+    def copy(self, src, dst):
+        """dst = src, src is kept"""
+        t = self.alloc()
+        self.clear(dst)
+        self.move(src, dst, t)
+        self.move(t, src)
+        self.free(t)
+
+    def if_nz(self, cell, body):
+        t = self.alloc()
+        self.copy(cell, t)
+
+        def once():
+            body()
+            self.clear(t)
+        self.loop(t, once)
+        self.free(t)
+
+    def if_else(self, cell, then, otherwise):
+        f = self.alloc()
+        self.set(f, 1)
+
+        def nz():
+            self.clear(f)
+            then()
+        self.if_nz(cell, nz)
+
+        def once():
+            otherwise()
+            self.clear(f)
+        self.loop(f, once)
+        self.free(f)
+
+    def if_z(self, cell, body):
+        self.if_else(cell, lambda: None, body)
+
+    def zero_cell(self):
+        """A cell followed by two scratch cells, for when_zero()"""
+        return self.alloc(3)
+
+    def when_zero(self, x, body):
+        """Runs body if x is zero, in constant time. x must come from
+        zero_cell(), its two neighbours stay zero outside of this."""
+        a, b = x + 1, x + 2
+        self.add(a, 1)
+        self.at(x)
+        self.emit('[>-]>')  # at b if x is not zero, at a otherwise
+        self.ptr = a
+        self.emit('[-')
+        body()
+        self.at(b)
+        self.emit(']')
+        self.ptr = b
+
+    def put(self, out, value, known):
+        """Prints a constant through cell out, whose value is known"""
+        self.add(out, value - known)
+        self.emit('.')
+        return value
+
+    def text(self):
+        return ''.join(self.code)
+
+
+def mandelbrot(rows=11, cols=20, max_iter=6, x0=-34, y0=-15, dx=2, dy=3):
+    """Escape-time renderer in fixed point with 4 fractional bits. Numbers
+    are kept as sign and magnitude; |z| is bounded before squaring, so
+    magnitudes stay within a cell."""
+    asm = Assembler()
+    chars = ' .:-=+*#%@'
+
+    def signed():
+        return (asm.alloc(), asm.zero_cell())  # sign, magnitude
+
+    cx, cy = signed(), signed()
+    zx, zy = signed(), signed()
+    zx2, zy2, prod = asm.zero_cell(), asm.zero_cell(), asm.zero_cell()
+    count, escaped, left = asm.alloc(), asm.alloc(), asm.alloc()
+    out = asm.alloc()
+
+    def mul(a, b, res, shift):
+        """res = a * b >> shift for magnitudes, a and b are kept. b is split
+        into whole and fractional parts first, so that only the fractional
+        part is added unit by unit."""
+        d = asm.zero_cell()
+        ta, tb, bh, bl = asm.alloc(), asm.alloc(), asm.alloc(), asm.alloc()
+        asm.clear(res)
+        asm.clear(bh)
+        asm.set(d, 1 << shift)
+        asm.copy(b, tb)
+
+        def split():
+            asm.add(tb, -1)
+            asm.add(d, -1)
+
+            def whole():
+                asm.add(d, 1 << shift)
+                asm.add(bh, 1)
+            asm.when_zero(d, whole)
+        asm.loop(tb, split)
+        asm.set(bl, 1 << shift)
+        asm.move(d, tb)
+        asm.loop(tb, lambda: (asm.add(tb, -1), asm.add(bl, -1)))
+        asm.set(d, 1 << shift)
+        asm.copy(a, ta)
+
+        def outer():
+            asm.add(ta, -1)
+            asm.copy(bh, tb)
+            asm.move(tb, res)
+            asm.copy(bl, tb)
+
+            def inner():
+                asm.add(tb, -1)
+                asm.add(d, -1)
+
+                def carry():
+                    asm.add(d, 1 << shift)
+                    asm.add(res, 1)
+                asm.when_zero(d, carry)
+            asm.loop(tb, inner)
+        asm.loop(ta, outer)
+        asm.clear(d)
+        asm.clear(bh)
+        asm.clear(bl)
+        asm.free(d, 3)
+        for c in (ta, tb, bh, bl):
+            asm.free(c)
+
+    def add_signed(dst, src):
+        """dst += src; src is kept"""
+        ds, dm = dst
+        ss, sm = src
+        t, same = asm.alloc(), asm.alloc()
+        asm.copy(sm, t)
+        # same = 1 - ds - ss + 2 * ds * ss, 1 if the signs are equal
+        asm.set(same, 1)
+        asm.if_nz(ds, lambda: asm.add(same, -1))
+        asm.if_nz(ss, lambda: asm.add(same, -1))
+        asm.if_nz(ds, lambda: asm.if_nz(ss, lambda: asm.add(same, 2)))
+
+        def subtract():
+            def unit():
+                asm.add(t, -1)
+
+                # Crossed zero: the rest is added with the sign of src
+                def cross():
+                    asm.add(dm, 2)
+                    asm.copy(ss, ds)
+                    asm.move(t, dm)
+                asm.when_zero(dm, cross)
+                asm.add(dm, -1)
+            asm.loop(t, unit)
+        asm.if_else(same, lambda: asm.move(t, dm), subtract)
+        asm.clear(same)
+        asm.free(t)
+        asm.free(same)
+
+    def greater(m, limit, flag):
+        """flag = 1 if magnitude m > limit"""
+        c = asm.zero_cell()
+        asm.copy(m, c)
+        for _ in range(limit):
+            asm.when_zero(c, lambda: asm.add(c, 1))
+            asm.add(c, -1)
+        asm.if_nz(c, lambda: asm.set(flag, 1))
+        asm.clear(c)
+        asm.free(c, 3)
+
+    def set_signed(v, value):
+        asm.set(v[0], 1 if value < 0 else 0)
+        asm.set(v[1], abs(value))
+
+    def step_signed(v, delta):
+        one = signed()
+        set_signed(one, delta)
+        add_signed(v, one)
+        asm.clear(one[0])
+        asm.clear(one[1])
+        asm.free(one[0])
+        asm.free(one[1], 3)
+
+    row = asm.alloc()
+    col = asm.alloc()
+    set_signed(cy, y0)
+    asm.set(row, rows)
+
+    def do_row():
+        asm.add(row, -1)
+        set_signed(cx, x0)
+        asm.set(col, cols)
+
+        def do_col():
+            asm.add(col, -1)
+            set_signed(zx, 0)
+            set_signed(zy, 0)
+            asm.clear(count)
+            asm.clear(escaped)
+            asm.set(left, max_iter)
+
+            def iteration():
+                asm.add(left, -1)
+
+                def iterate():
+                    greater(zx[1], 32, escaped)
+                    greater(zy[1], 32, escaped)
+
+                    def square():
+                        mul(zx[1], zx[1], zx2, 4)
+                        mul(zy[1], zy[1], zy2, 4)
+                        s = asm.zero_cell()
+                        asm.copy(zx2, s)
+                        t = asm.alloc()
+                        asm.copy(zy2, t)
+                        asm.move(t, s)
+                        asm.free(t)
+                        greater(s, 64, escaped)
+                        asm.clear(s)
+                        asm.free(s, 3)
+
+                        def update():
+                            asm.add(count, 1)
+                            # zy = 2 * zx * zy + cy
+                            ps = asm.alloc()
+                            mul(zx[1], zy[1], prod, 3)
+                            asm.clear(ps)
+                            asm.if_nz(zx[0], lambda: asm.add(ps, 1))
+                            asm.if_nz(zy[0], lambda: asm.add(ps, 1))
+                            asm.if_nz(zx[0], lambda: asm.if_nz(
+                                zy[0], lambda: asm.clear(ps)))
+                            asm.clear(zy[0])
+                            asm.clear(zy[1])
+                            add_signed(zy, (ps, prod))
+                            add_signed(zy, cy)
+                            asm.clear(ps)
+                            asm.clear(prod)
+                            asm.free(ps)
+                            # zx = zx^2 - zy^2 + cx
+                            asm.clear(zx[0])
+                            asm.clear(zx[1])
+                            asm.move(zx2, zx[1])
+                            neg = asm.alloc()
+                            asm.set(neg, 1)
+                            add_signed(zx, (neg, zy2))
+                            add_signed(zx, cx)
+                            asm.clear(neg)
+                            asm.free(neg)
+                        asm.if_z(escaped, update)
+                        asm.clear(zx2)
+                        asm.clear(zy2)
+                    asm.if_z(escaped, square)
+                asm.if_z(escaped, iterate)
+                asm.if_nz(escaped, lambda: asm.clear(left))
+            asm.loop(left, iteration)
+            # Shade by iterations done, the set itself is the darkest
+            asm.if_z(escaped, lambda: asm.add(count, 1))
+            for i, ch in enumerate(chars[:max_iter + 2]):
+                level = asm.zero_cell()
+                asm.copy(count, level)
+                asm.add(level, -i)
+                asm.when_zero(level, lambda: asm.set(out, ord(ch)))
+                asm.clear(level)
+                asm.free(level, 3)
+            asm.at(out)
+            asm.emit('.')
+            asm.clear(out)
+            step_signed(cx, dx)
+        asm.loop(col, do_col)
+        asm.put(out, ord('\n'), 0)
+        asm.clear(out)
+        step_signed(cy, dy)
+    asm.loop(row, do_row)
+    return asm.text()
+
+
+def hanoi(discs=10):
+    """Iterative solution: the disc to move is given by the lowest zero bit
+    of a binary move counter and always moves in the same direction."""
+    asm = Assembler()
+    bits = [asm.alloc() for _ in range(discs)]
+    pegs = [asm.alloc() for _ in range(discs)]
+    carry, running, out = asm.alloc(), asm.alloc(), asm.alloc()
+
+    def print_peg(peg):
+        asm.set(out, ord('A'))
+        t = asm.alloc()
+        asm.copy(peg, t)
+        asm.move(t, out)
+        asm.free(t)
+        asm.at(out)
+        asm.emit('.')
+        asm.clear(out)
+
+    def move_disc(d):
+        peg = pegs[d]
+        print_peg(peg)
+        known = asm.put(out, ord('-'), 0)
+        known = asm.put(out, ord('>'), known)
+        asm.clear(out)
+        for _ in range(1 if (discs - d) % 2 == 0 else 2):
+            asm.add(peg, 1)
+            w = asm.zero_cell()
+            asm.copy(peg, w)
+            asm.add(w, -3)
+            asm.when_zero(w, lambda: asm.clear(peg))
+            asm.clear(w)
+            asm.free(w, 3)
+        print_peg(peg)
+        asm.put(out, ord('\n'), 0)
+        asm.clear(out)
+
+    asm.set(running, 1)
+
+    def step():
+        asm.set(carry, 1)
+        for d in range(discs):
+            def with_carry(d=d):
+                def was_set():
+                    asm.clear(bits[d])
+                    asm.add(done, 1)
+
+                def was_clear():
+                    asm.set(bits[d], 1)
+                    asm.clear(carry)
+                    move_disc(d)
+                done = asm.alloc()
+                asm.clear(done)
+                asm.if_nz(bits[d], was_set)
+                asm.if_z(done, was_clear)
+                asm.clear(done)
+                asm.free(done)
+            asm.if_nz(carry, with_carry)
+        asm.if_nz(carry, lambda: asm.clear(running))
+        asm.clear(carry)
+    asm.loop(running, step)
+    return asm.text()
+
+
+def main():
+    outdir = sys.argv[1] if len(sys.argv) > 1 else os.path.join(
+        os.path.dirname(os.path.abspath(__file__)), 'progs')
+    for name, text in (('mandelbrot', mandelbrot()), ('hanoi', hanoi())):
+        with open(os.path.join(outdir, name + '.b'), 'w') as f:
+            f.write(text + '\n')
+
+
+if __name__ == '__main__':
+    main()
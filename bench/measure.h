@@ -0,0 +1,60 @@
+// Repeated timings with warmup and their 95% confidence interval, shared
+// by the benchmarks and bench-compare
+
+#ifndef MEASURE_H_
+#define MEASURE_H_
+
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+typedef std::chrono::steady_clock bench_clock;
+
+/* Two-sided 95% quantiles of Student's t distribution, by degrees of freedom.
+ * The only copy of the table; callers with fractional df round it down */
+static inline double t95(unsigned df) {
+    static const double table[] = { 0, 12.71, 4.30, 3.18, 2.78, 2.57, 2.45,
+        2.36, 2.31, 2.26, 2.23, 2.20, 2.18, 2.16, 2.14, 2.13, 2.12, 2.11,
+        2.10, 2.09, 2.09, 2.08, 2.07, 2.07, 2.06, 2.06, 2.06, 2.05, 2.05,
+        2.05, 2.04 };
+    return df < sizeof(table) / sizeof(table[0]) ? table[df] : 1.96;
+}
+
+struct measurement_t {
+    double mean;
+    double ci;  // half width of the 95% confidence interval
+    double min;
+    double max;
+};
+
+/* IN: at least one sample */
+static inline measurement_t summarize(const std::vector<double> &v) {
+    double mean = 0, var = 0;
+    for (double x: v)
+        mean += x;
+    mean /= v.size();
+    for (double x: v)
+        var += (x - mean) * (x - mean);
+    double ci = v.size() > 1 ? 
+                t95(v.size() - 1) * std::sqrt(var / (v.size() - 1) / v.size()) : 0;
+    return { mean, ci, *std::min_element(v.begin(), v.end()), 
+             *std::max_element(v.begin(), v.end()) };
+}
+
+/* Runs body warmup + reps times. RETURN: seconds of every timed run */
+template <typename F>
+static std::vector<double> time_runs(unsigned reps, unsigned warmup, F body) {
+    for (unsigned i = 0; i < warmup; i++)
+        body();
+    std::vector<double> sec;
+    for (unsigned i = 0; i < reps; i++) {
+        auto start = bench_clock::now();
+        body();
+        sec.push_back(std::chrono::duration<double>(
+                            bench_clock::now() - start).count());
+    }
+    return sec;
+}
+
+#endif // MEASURE_H_
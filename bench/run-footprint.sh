@@ -0,0 +1,50 @@
+#!/usr/bin/env bash
+# Peak RSS of bofsim and host memory held by its components while tape 
+# length (TL, with the whole tape written), stack depth (SD) and program 
+# size (IL) are swept. Prints JSON.
+# Usage: run-footprint.sh [path/to/bofsim]
+
+BOFSIM=${1:-../bofsim}
+
+if [ ! -x "$BOFSIM" ]
+then
+    echo "Simulator $BOFSIM is not found" >&2
+    exit 1
+fi
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+echo -n '+[>+]' > "$TMP/fill.b"   # writes every cell up to the end of tape
+echo -n '+.' > "$TMP/tiny.b"
+
+# Runs bofsim with given options, prints a JSON object for the sweep point
+point() {
+    local sweep=$1 value=$2
+    shift 2
+    "$BOFSIM" --lean --footprint --steps=2000000000 "$@" 2>&1 >/dev/null \
+              </dev/null | awk -v sweep="$sweep" -v value="$value" '
+        /components total/ { total = $3 }
+        /^  RSS /          { rss = $2 }
+        /peak RSS/         { peak = $3 }
+        END { printf "{\"sweep\": \"%s\", \"value\": %s, \"components\": %d,"\
+                     " \"rss\": %d, \"peak_rss\": %d}", 
+                     sweep, value, total, rss, peak }'
+}
+
+printf '{"bofsim": "%s", "points": [' "$BOFSIM"
+SEP=""
+for TL in 10 14 18 22
+do
+    printf '%s\n  %s' "$SEP" "$(point tl $TL --acode="$TMP/fill.b" --cfg=tl=$TL)"
+    SEP=","
+done
+for SD in 16 4096 65536 1048576
+do
+    printf ',\n  %s' "$(point sd $SD --acode="$TMP/tiny.b" --cfg=sd=$SD)"
+done
+for IL in 4096 65536 1048576 16777216
+do
+    head -c $IL /dev/zero | tr '\0' '+' > "$TMP/long.b"
+    printf ',\n  %s' "$(point il $IL --acode="$TMP/long.b" --cfg=il=$IL)"
+done
+printf '\n]}\n'
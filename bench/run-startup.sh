@@ -0,0 +1,55 @@
+#!/usr/bin/env bash
+# Startup latency of bofsim on a tiny program: median time to the first
+# simulated instruction, as bofsim --lean reports it, and median time of
+# the whole process as seen from outside, with and without --lean.
+# Prints JSON. Needs bash 5 for EPOCHREALTIME.
+# Usage: run-startup.sh [path/to/bofsim] [runs]
+
+BOFSIM=${1:-../bofsim}
+RUNS=${2:-100}
+
+if [ ! -x "$BOFSIM" ]
+then
+    echo "Simulator $BOFSIM is not found" >&2
+    exit 1
+fi
+if [ -z "$EPOCHREALTIME" ]
+then
+    echo "EPOCHREALTIME is not supported by this shell" >&2
+    exit 1
+fi
+
+PROG=$(mktemp)
+trap 'rm -f "$PROG"' EXIT
+echo -n '++++++++[>++++++++<-]>+.' > "$PROG"
+
+median() {
+    sort -g | awk '{ v[NR] = $1 } 
+        END { print (NR % 2) ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2 }'
+}
+
+# Microseconds of wall time per run of bofsim with given options
+wall_times() {
+    for ((i = 0; i < RUNS; i++))
+    do
+        local t0=$EPOCHREALTIME
+        "$BOFSIM" --acode="$PROG" --steps=1000 "$@" >/dev/null 2>&1 </dev/null
+        local t1=$EPOCHREALTIME
+        echo "$t0 $t1" | awk '{ printf "%.1f\n", ($2 - $1) * 1e6 }'
+    done
+}
+
+# Field of the startup breakdown line, microseconds since main()
+breakdown() {
+    for ((i = 0; i < RUNS; i++))
+    do
+        "$BOFSIM" --acode="$PROG" --steps=1000 --lean 2>&1 >/dev/null </dev/null |
+            sed -n "s/.*Startup, us:.* $1 \([0-9.]*\).*/\1/p"
+    done
+}
+
+echo "{\"bofsim\": \"$BOFSIM\", \"runs\": $RUNS," \
+     "\"first_step_us\": $(breakdown "first step" | median)," \
+     "\"exit_in_main_us\": $(breakdown exit | median)," \
+     "\"process_us\": $(wall_times | median)," \
+     "\"process_lean_us\": $(wall_times --lean | median)}"
@@ -0,0 +1,73 @@
+#!/usr/bin/env bash
+# Runs every program of progs/ several times under bofsim and prints
+# median simulation speed and wall time per program as JSON, one program
+# per line. Speeds of individual runs are kept for bench-compare.
+# Speed comes from --stats=speed, which attaches no observers, so that the
+# interpreter itself is measured. Extra options of a program, such as a 
+# larger IL, are read from progs/<name>.opts.
+# Usage: run-suite.sh [path/to/bofsim] [repetitions] [program names...]
+
+BOFSIM=${1:-../bofsim}
+REPS=${2:-5}
+shift 2 2>/dev/null
+PROGS_DIR=$(dirname "$0")/progs
+MAX_STEPS=2000000000
+
+if [ ! -x "$BOFSIM" ]
+then
+    echo "Simulator $BOFSIM is not found" >&2
+    exit 1
+fi
+
+if [ $# -gt 0 ]
+then
+    NAMES="$@"
+else
+    NAMES=$(cd "$PROGS_DIR" && ls *.b | grep -v '\.sup\.b$' | sed 's/\.b$//')
+fi
+
+# Prints the value of a numeric field of a one-line JSON object
+field() {
+    sed -n "s/.*\"$1\": \([0-9.e+-]*\).*/\1/p"
+}
+
+median() {
+    sort -g | awk '{ v[NR] = $1 } 
+        END { print (NR % 2) ? v[(NR + 1) / 2] : (v[NR / 2] + v[NR / 2 + 1]) / 2 }'
+}
+
+printf '{"bofsim": "%s", "repetitions": %d, "benchmarks": [' "$BOFSIM" "$REPS"
+SEP=""
+STATUS=0
+for NAME in $NAMES
+do
+    ACODE="$PROGS_DIR/$NAME.b"
+    ARGS="--acode=$ACODE --steps=$MAX_STEPS --stats=speed --lean --log-level=0"
+    [ -f "$PROGS_DIR/$NAME.sup.b" ] && ARGS="$ARGS --scode=$PROGS_DIR/$NAME.sup.b"
+    [ -f "$PROGS_DIR/$NAME.opts" ] && ARGS="$ARGS $(cat "$PROGS_DIR/$NAME.opts")"
+    WALL=""; SPS=""; CPS=""
+    for ((i = 0; i < REPS; i++))
+    do
+        STATS=$("$BOFSIM" $ARGS 2>&1 >/dev/null </dev/null | grep '^{"steps"')
+        if [ -z "$STATS" ]
+        then
+            echo "$NAME: no statistics from $BOFSIM" >&2
+            STATUS=1
+            continue 2
+        fi
+        STEPS=$(echo "$STATS" | field steps)
+        CYCLES=$(echo "$STATS" | field cycles)
+        WALL="$WALL $(echo "$STATS" | field wall_seconds)"
+        SPS="$SPS $(echo "$STATS" | field steps_per_second)"
+        CPS="$CPS $(echo "$STATS" | field cycles_per_second)"
+    done
+    printf '%s\n  ' "$SEP"
+    echo -n "{\"name\": \"$NAME\", \"steps\": $STEPS, \"cycles\": $CYCLES," \
+         "\"wall_seconds\": $(echo $WALL | tr ' ' '\n' | median)," \
+         "\"steps_per_second\": $(echo $SPS | tr ' ' '\n' | median)," \
+         "\"cycles_per_second\": $(echo $CPS | tr ' ' '\n' | median)," \
+         "\"steps_per_second_runs\": [$(echo $SPS | sed 's/ /, /g')]}"
+    SEP=","
+done
+printf '\n]}\n'
+exit $STATUS
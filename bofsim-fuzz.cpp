@@ -0,0 +1,94 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/* Differential fuzzer for the execution engines: runs random programs from
+ * ProgramGenerator on the step-by-step reference engine and on candidates
+ * (batched and folded execution) and reports the first divergent step */
+// Usage: bofsim-fuzz [programs] [seed] [engine: batch, fold or all]
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstdlib>
+
+#include "diffexec.h"
+#include "progen.h"
+
+static std::string escaped(const std::string &s) {
+    std::string r;
+    for (char c: s) {
+        if (c >= 0x20 && c < 0x7f && c != '\\') {
+            r += c;
+        } else {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\x%02x", (uint8_t)c);
+            r += buf;
+        }
+    }
+    return r;
+}
+
+int main(int argc, char** argv) {
+    unsigned long programs = argc > 1 ? strtoul(argv[1], nullptr, 0) : 1000;
+    uint64_t seed = argc > 2 ? strtoull(argv[2], nullptr, 0) : 1;
+    std::string which = argc > 3 ? argv[3] : "all";
+    
+    std::vector<std::unique_ptr<EngineIface>> engines;
+    if (which == "batch" || which == "all")
+        engines.emplace_back(new BatchEngine());
+    if (which == "fold" || which == "all")
+        engines.emplace_back(new FoldEngine());
+    if (engines.empty()) {
+        std::cerr << "Unknown engine " << which << std::endl;
+        return 2;
+    }
+    
+    ProgramGenerator gen("progen", seed);
+    DifferentialHarness harness("harness");
+    for (unsigned long i = 0; i < programs; i++) {
+        random_program_t p = gen.Next();
+        for (auto &e: engines) {
+            divergence_t d = harness.Run(p, *e);
+            if (!d.found)
+                continue;
+            std::cout << "Engine " << e->Name() << " diverges on program " 
+                      << i << " of seed " << seed << " after step " 
+                      << d.step << " (" << d.what << ")\n"
+                      << "acode: " << escaped(p.acode) << '\n'
+                      << "scode: " << escaped(p.scode) << '\n'
+                      << "tape:  " << escaped(p.tape) << '\n'
+                      << "input: " << escaped(p.input) << '\n'
+                      << "sd:    " << p.cfg.Get("sd") << '\n'
+                      << "reference:\n" << d.reference 
+                      << "candidate:\n" << d.candidate;
+            return 1;
+        }
+    }
+    std::cout << programs << " programs, no divergence\n";
+    return 0;
+}
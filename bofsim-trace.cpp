@@ -0,0 +1,96 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+/* Decoder for binary traces written by bofsim --trace */
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+
+#include "bofsim.h"
+#include "trace.h"
+
+static const char* mode_name(uint8_t mode) {
+    switch (mode) {
+    case ApplicationMode: return "app";
+    case SupervisorMode:  return "sup";
+    case HaltMode:        return "halt";
+    default:              return "?";
+    }
+}
+
+static const char* result_name(uint8_t res) {
+    switch ((ExecuteResult)res) {
+    case ExecuteResult::Regular:     return "regular";
+    case ExecuteResult::ControlFlow: return "controlflow";
+    case ExecuteResult::Violation:   return "violation";
+    case ExecuteResult::Skipping:    return "skipping";
+    case ExecuteResult::Nop:         return "nop";
+    case ExecuteResult::Halt:        return "halt";
+    case ExecuteResult::WouldBlock:  return "wouldblock";
+    default:                         return "?";
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "Usage: bofsim-trace file\n";
+        return 1;
+    }
+    std::ifstream in(argv[1], std::ios::binary);
+    trace_header_t hdr;
+    if (!in.read((char*)&hdr, sizeof(hdr)) || 
+        memcmp(hdr.magic, trace_magic, sizeof(hdr.magic))) {
+        std::cerr << argv[1] << " is not a bofsim trace\n";
+        return 1;
+    }
+    if (hdr.version != trace_version || 
+        hdr.record_size != sizeof(step_record_t)) {
+        std::cerr << "Unsupported trace version " << hdr.version << "\n";
+        return 1;
+    }
+    std::cout << "# " << hdr.count << " records, " 
+              << hdr.lost << " earlier records lost\n"
+              << "# step pc mode opcode tp value sp cycles result\n";
+    step_record_t rec;
+    for (uint64_t i = 0; i < hdr.count; i++) {
+        if (!in.read((char*)&rec, sizeof(rec))) {
+            std::cerr << "Trace is truncated\n";
+            return 1;
+        }
+        char opcode[8];
+        if (rec.opcode >= 0x20 && rec.opcode < 0x7f)
+            snprintf(opcode, sizeof(opcode), "'%c'", rec.opcode);
+        else
+            snprintf(opcode, sizeof(opcode), "0x%02x", rec.opcode);
+        std::cout << rec.step << ' ' << rec.pc << ' ' 
+                  << mode_name(rec.mode) << ' ' << opcode << ' '
+                  << rec.tp << ' ' << rec.value << ' ' << rec.sp << ' '
+                  << rec.cycles << ' ' << result_name(rec.result) << '\n';
+    }
+    return 0;
+}
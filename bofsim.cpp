@@ -25,62 +25,78 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 
+#include <algorithm>
+
 #include "bofsim.h"
 #include "memory.h"
 #include "iodev.h"
+#include "costmodel.h"
 
 void BfCpu::ProcessViolation(uint8_t opc, uint8_t tap) {
+    violations++;
     if (sr.mode != ApplicationMode) {
         info(2, "Violation in non-application mode, going to Halt");
         sr.mode = HaltMode;
         return;
     }
-    info(4, "Violation in application mode, switching to supervisor");
+    LOG_INFO(4, "Violation in application mode, switching to supervisor");
     inactive_pc = pc;
     pc = 0;
     inactive_sp = sp;
     sp = 0;
     inactive_sk = sk;
     sk = 0;
+    call_stack.swap(inactive_call_stack);
     sr.opcode = opc;
     sr.tape = tap;
     sr.mode = SupervisorMode;
+    supervisor_entries++;
 }
 
 void BfCpu::ReturnToApplicationMode() {
-    info(1, "ReturnToApplicationMode not implemented");
-    
-    
+    LOG_INFO(4, "Returning to application mode");
+    pc = inactive_pc;
+    sp = inactive_sp;
+    sk = inactive_sk;
+    call_stack.swap(inactive_call_stack);
+    sr.mode = ApplicationMode;
 }
 
-steps_cycles_t BfCpu::Execute(cycle_t max_cycles) {
-    cycle_t i = 0;
-    for (i = 0; i < max_cycles; i++)
-        ExecuteOneStep();
-    return {max_cycles, max_cycles};
+steps_cycles_t BfCpu::Execute(step_t max_steps) {
+    steps_cycles_t total{0, 0};
+    const processor_mode_t mode = sr.mode;
+    while (total.first < max_steps) {
+        steps_cycles_t done = ExecuteOneStep();
+        if (done.first == 0) // halted or blocked on input
+            break;
+        total.first += done.first;
+        total.second += done.second;
+        if (stop_on_mode_change && sr.mode != mode)
+            break;
+    }
+    return total;
 }
 
 steps_cycles_t BfCpu::ExecuteOneStep() {
     
-    /* Instruction execution result 
-     * Currently affects whether PC will be advanced.
-     */
-    enum class ExecuteResult {
-        Regular = 0,
-        ControlFlow,
-        Violation,
-        Skipping,
-        Nop,
-        Halt,
-    };
-    
     if (sr.mode == HaltMode) {// processor is disabled
-        info(4, "CPU is disabled");
+        LOG_INFO(4, "CPU is disabled");
         return {0,1};
     }
     
     char opcode{0};
     my_uint128_t tape_val{0};
+    const address_t old_pc = pc, old_tp = tp;
+    const processor_mode_t old_mode = sr.mode;
+    const bool old_skipping = sk > 0;
+    if (snapshot) {
+        snapshot->pc = pc;
+        snapshot->tp = tp;
+        snapshot->mode = sr.mode;
+        snapshot->skipping = old_skipping;
+    }
+    MemoryIface &tmem = sr.mode == SupervisorMode ? 
+                            static_cast<MemoryIface&>(sv_map) : tape_mem;
     /* Fetch */
     switch (sr.mode) {
     case ApplicationMode:
@@ -93,7 +109,7 @@ steps_cycles_t BfCpu::ExecuteOneStep() {
         error("Unsupported processor mode for execution");
         break;
     }
-    info(4, std::string("Opcode read ") + std::string(1, opcode));
+    LOG_INFO(4, "Opcode read " << opcode);
         
     /* Decode and Execute */
     ExecuteResult res = ExecuteResult::Regular;
@@ -103,7 +119,7 @@ steps_cycles_t BfCpu::ExecuteOneStep() {
                       opcode != ']' and
                       opcode != '\0')
     ) {
-        info(4, "Skipping...");
+        LOG_INFO(4, "Skipping...");
         res = ExecuteResult::Skipping;
     } else switch (opcode) {
     case '\0':
@@ -112,7 +128,7 @@ steps_cycles_t BfCpu::ExecuteOneStep() {
         break;
     case '>':
         if (tp >= tl-1) {
-            uint8_t tape8 = (uint8_t)dynamic_cast<MemoryIface&>(tape).Read(tp);
+            uint8_t tape8 = (uint8_t)tmem.Read(tp);
             ProcessViolation(opcode, tape8);
             res = ExecuteResult::Violation;
         } else {
@@ -122,7 +138,7 @@ steps_cycles_t BfCpu::ExecuteOneStep() {
         break;
     case '<':
         if (tp == 0 ) {
-            uint8_t tape8 = (uint8_t)dynamic_cast<MemoryIface&>(tape).Read(tp);
+            uint8_t tape8 = (uint8_t)tmem.Read(tp);
             ProcessViolation(opcode, tape8);
             res = ExecuteResult::Violation;
         } else {
@@ -131,32 +147,32 @@ steps_cycles_t BfCpu::ExecuteOneStep() {
         }
         break;
     case '+':
-        tape_val = dynamic_cast<MemoryIface&>(tape).Read(tp);
+        tape_val = tmem.Read(tp);
         tape_val = (tape_val+1) & tape_mask; // increase and handle overflow
-        dynamic_cast<MemoryIface&>(tape).Write(tp, tape_val);
+        tmem.Write(tp, tape_val);
         res = ExecuteResult::Regular;
         break;
     case '-':
-        tape_val = dynamic_cast<MemoryIface&>(tape).Read(tp);
+        tape_val = tmem.Read(tp);
         tape_val = (tape_val-1) & tape_mask; // increase and handle overflow
-        dynamic_cast<MemoryIface&>(tape).Write(tp, tape_val);
+        tmem.Write(tp, tape_val);
         res = ExecuteResult::Regular;
         break;
     case '[':
-        tape_val = dynamic_cast<MemoryIface&>(tape).Read(tp);
+        tape_val = tmem.Read(tp);
         if (sk > 0) {
             sk++;
             res = ExecuteResult::Skipping;
         } else if (tape_val == 0) {
-            info(2, std::string("Entering skipping mode at PC = ") + std::to_string(pc));
+            LOG_INFO(2, "Entering skipping mode at PC = " << pc);
             sk = 1;
             res = ExecuteResult::Skipping;
         } else {
-            if (sp > sd) {
+            if (sp >= sd) {
                 ProcessViolation(opcode, (uint8_t)tape_val);
                 res = ExecuteResult::Violation;
             } else {
-                info(2, std::string("Entering loop at PC = ") + std::to_string(pc));
+                LOG_INFO(2, "Entering loop at PC = " << pc);
                 call_stack[sp] = pc;
                 sp ++;
                 res = ExecuteResult::Regular;
@@ -164,26 +180,29 @@ steps_cycles_t BfCpu::ExecuteOneStep() {
         }
         break;
     case ']':
-        tape_val = dynamic_cast<MemoryIface&>(tape).Read(tp);
+        tape_val = tmem.Read(tp);
         if (sk == 0) {
-            if (sp == 0) {
-                    ProcessViolation(opcode, (uint8_t)tape_val);
-                    res = ExecuteResult::Violation;
+            if (sp == 0 && sr.mode == SupervisorMode) {
+                ReturnToApplicationMode();
+                res = ExecuteResult::ControlFlow;
+            } else if (sp == 0) {
+                ProcessViolation(opcode, (uint8_t)tape_val);
+                res = ExecuteResult::Violation;
             } else {
                 sp--;
                 if (tape_val != 0) {
                     pc = call_stack[sp];
-                    info(2, std::string("Loop to PC = ") + std::to_string(pc));
+                    LOG_INFO(2, "Loop to PC = " << pc);
                     res = ExecuteResult::ControlFlow;
                 } else {
-                    info (2, std::string("Exiting loop at PC = ") + std::to_string(pc));
+                    LOG_INFO(2, "Exiting loop at PC = " << pc);
                     res = ExecuteResult::Regular;
                 }
             }
         } else {
             sk--;
             if (sk == 0) {
-                info(2, "Leaving skipping mode");
+                LOG_INFO(2, "Leaving skipping mode");
                 res = ExecuteResult::Regular;
             } else {
                 res = ExecuteResult::Skipping;
@@ -191,12 +210,16 @@ steps_cycles_t BfCpu::ExecuteOneStep() {
         }
         break;
     case '.': // output
-        tape_val = dynamic_cast<MemoryIface&>(tape).Read(tp);
+        tape_val = tmem.Read(tp);
         dynamic_cast<IOIface&>(iodev).Write(tape_val);
         res = ExecuteResult::Regular;
         break;
     case ',': // input
-        tape_val = dynamic_cast<IOIface&>(iodev).Read();
+        if (!dynamic_cast<IOIface&>(iodev).TryRead(tape_val)) {
+            res = ExecuteResult::WouldBlock;
+            break;
+        }
+        tmem.Write(tp, tape_val & tape_mask);
         res = ExecuteResult::Regular;
         break;
     default:
@@ -216,13 +239,82 @@ steps_cycles_t BfCpu::ExecuteOneStep() {
     case ExecuteResult::Halt:
         // PC is already changed.
         break;
+    case ExecuteResult::WouldBlock:
+        // Nothing is done, the instruction will be restarted
+        waiting_input = true;
+        return {0, 0};
     default:
         assert(0 && "Unreachable");
         break;
     }
+    waiting_input = false;
+    if (cost_model)
+        spent = cost_model->Cycles((uint8_t)opcode, res, old_mode, old_tp);
+    if (pc_counters) {
+        std::vector<pc_counter_t> &counters = pc_counters[old_mode];
+        if (old_pc < counters.size()) {
+            counters[old_pc].steps++;
+            counters[old_pc].cycles += spent;
+        }
+    }
+    steps_done++;
+    cycles_done += spent;
+    if (!observers.empty()) {
+        step_record_t rec = {};
+        rec.step = steps_done;
+        rec.pc = old_pc;
+        rec.tp = old_tp;
+        rec.value = tape_val;
+        rec.sp = sp;
+        rec.cycles = spent;
+        rec.opcode = (uint8_t)opcode;
+        rec.mode = old_mode;
+        rec.result = (uint8_t)res;
+        rec.skipping = old_skipping;
+        for (auto o: observers)
+            o->OnStep(rec);
+    }
     return {1, spent};
 } // ExecuteOneStep
     
+my_uint128_t SupervisorRegs::Read(address_t offset) {
+    switch (offset) {
+    case SavedPC: return cpu.inactive_pc;
+    case SR:      return cpu.sr.val();
+    case SavedSP: return cpu.inactive_sp;
+    case SavedSK: return cpu.inactive_sk;
+    case Steps:     return cpu.steps_done;
+    case Cycles:    return cpu.cycles_done;
+    case SvEntries: return cpu.supervisor_entries;
+    default:
+        assert(0 && "Unreachable");
+        return 0;
+    }
+}
+
+void SupervisorRegs::Write(address_t offset, my_uint128_t val) {
+    switch (offset) {
+    case SavedPC: cpu.inactive_pc = val; break;
+    case SR: { // mode cannot be changed this way
+        status_register_t new_sr(val);
+        cpu.sr.opcode = new_sr.opcode;
+        cpu.sr.tape = new_sr.tape;
+        break;
+    }
+    case SavedSP: // entries above SD do not exist
+        cpu.inactive_sp = std::min<my_uint128_t>(val, cpu.sd); 
+        break;
+    case SavedSK: cpu.inactive_sk = val; break;
+    case Steps:
+    case Cycles:
+    case SvEntries:
+        break; // counters are read-only
+    default:
+        assert(0 && "Unreachable");
+        break;
+    }
+}
+
 void BfCpu::SetRegister(const std::string &name, const my_uint128_t &val) {
     /* TODO add validation for val */
     if (!name.compare("pc")) {
@@ -236,3 +328,32 @@ void BfCpu::SetRegister(const std::string &name, const my_uint128_t &val) {
     
 }
 
+
+void BfCpu::SaveState(std::ostream &out) const {
+    out << pc << ' ' << inactive_pc << ' ' << tp << ' ' 
+        << sp << ' ' << inactive_sp << ' ' << sr.val() << ' '
+        << sk << ' ' << inactive_sk << ' ' 
+        << steps_done << ' ' << cycles_done << ' ' << supervisor_entries;
+    for (address_t i = 0; i < sp; i++)
+        out << ' ' << call_stack[i];
+    for (address_t i = 0; i < inactive_sp; i++)
+        out << ' ' << inactive_call_stack[i];
+    out << '\n';
+}
+
+void BfCpu::RestoreState(std::istream &in) {
+    uint64_t sr_val{0};
+    in >> pc >> inactive_pc >> tp >> sp >> inactive_sp >> sr_val 
+       >> sk >> inactive_sk 
+       >> steps_done >> cycles_done >> supervisor_entries;
+    if (!in || sp > call_stack.size() || inactive_sp > call_stack.size())
+        error("Bad processor state");
+    sr = status_register_t(sr_val);
+    for (address_t i = 0; i < sp; i++)
+        in >> call_stack[i];
+    for (address_t i = 0; i < inactive_sp; i++)
+        in >> inactive_call_stack[i];
+    if (!in)
+        error("Bad processor state");
+    waiting_input = false;
+}
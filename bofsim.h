@@ -37,6 +37,8 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "object.h"
 #include "log.h"
 #include "config.h"
+#include "memory.h"
+#include "addrmap.h"
 
 typedef enum {
     ApplicationMode = 0,
@@ -62,7 +64,86 @@ struct status_register_t {
         mode( processor_mode_t((value >> 16) & 0xff)) {};
 };
 
-class BfCpu: public SimObject, public RegisterAccessIface {
+/* Instruction execution result 
+ * Currently affects whether PC will be advanced.
+ */
+enum class ExecuteResult: uint8_t {
+    Regular = 0,
+    ControlFlow,
+    Violation,
+    Skipping,
+    Nop,
+    Halt,
+    WouldBlock,
+};
+
+/* What one retired step did, as seen by execution observers.
+ * Fixed-width fields so that it can be stored in binary traces as is. */
+struct step_record_t {
+    uint64_t step;   // number of the step, counting from 1
+    uint64_t pc;     // of the instruction
+    uint64_t tp;     // before execution
+    uint64_t value;  // tape cell value the instruction worked with
+    uint64_t sp;     // after execution
+    uint64_t cycles; // spent by the instruction
+    uint8_t opcode;
+    uint8_t mode;    // processor_mode_t the instruction was executed in
+    uint8_t result;  // ExecuteResult
+    uint8_t skipping; // SK was above zero before execution
+    uint8_t reserved[4];
+};
+
+/* Receives every retired step. Costs nothing when none are attached. */
+class ExecutionObserverIface {
+public:
+    virtual void OnStep(const step_record_t &rec) = 0;
+};
+
+/* Where the processor currently is, for asynchronous readers such as 
+ * signal handlers. Written at the start of every step once handed to the 
+ * processor; fields are individually atomic on the hosts we run on but 
+ * may be mutually torn. */
+struct guest_snapshot_t {
+    volatile address_t pc;
+    volatile address_t tp;
+    volatile uint8_t mode;     // processor_mode_t
+    volatile uint8_t skipping; // looking for a matching bracket
+};
+
+/* Steps and cycles of one instruction, counted by the processor itself
+ * when a profiler hands it flat per-PC arrays */
+struct pc_counter_t {
+    step_t steps;
+    cycle_t cycles;
+};
+
+class BfCpu;
+class CostModel;
+
+/* Saved application registers, mapped into supervisor tape space,
+ * followed by read-only counters of retired steps, cycles and supervisor 
+ * entries. Counters do not include the instruction reading them. */
+class SupervisorRegs: public MappedDeviceIface {
+    BfCpu &cpu;
+public:
+    enum {
+        SavedPC = 0,
+        SR,
+        SavedSP,
+        SavedSK,
+        Steps,
+        Cycles,
+        SvEntries,
+        Count
+    };
+    SupervisorRegs(BfCpu &_cpu): cpu(_cpu) {};
+    virtual my_uint128_t Read(address_t offset);
+    virtual void Write(address_t offset, my_uint128_t val);
+};
+
+class BfCpu: public SimObject, public RegisterAccessIface, 
+             public FootprintIface {
+    friend class SupervisorRegs;
     
     SimObject &tape;
     SimObject &acode;
@@ -89,9 +170,32 @@ class BfCpu: public SimObject, public RegisterAccessIface {
     my_uint128_t sd; // stack depth
     my_uint128_t il; // instruction memory capacity
     
-    /* Stack */
+    /* Stack, one per mode so that supervisor loops keep the open loops 
+     * of the application */
     std::vector<address_t> call_stack;
+    std::vector<address_t> inactive_call_stack;
+    
+    bool waiting_input; // last ',' found no data, PC stays at it
+    
+    /* Statistics */
+    step_t steps_done;
+    cycle_t cycles_done;
+    uint64_t violations;
+    uint64_t supervisor_entries;
+    std::vector<ExecutionObserverIface*> observers;
+    bool stop_on_mode_change; // for per-mode accounting by the host
+    guest_snapshot_t *snapshot; // not kept if nullptr
+    CostModel *cost_model; // flat cost of one cycle per instruction if none
+    std::vector<pc_counter_t> *pc_counters; // per mode, indexed by PC
+    
+    /* Tape as seen from application mode: plain memory */
+    MemoryIface &tape_mem;
+    /* Tape as seen from supervisor mode: registers and devices mapped */
+    SupervisorRegs sv_regs;
+    AddressMap sv_map;
 public:
+    static const address_t sv_regs_base = 1000;
+    
     BfCpu(const std::string & _name,
           const Configuration & cfg,
           SimObject & _tape, 
@@ -111,41 +215,114 @@ public:
     inactive_sp(0),
     sr(0),
     sk(0),
-    inactive_sk(0)
+    inactive_sk(0),
+    waiting_input(false),
+    steps_done(0),
+    cycles_done(0),
+    violations(0),
+    supervisor_entries(0),
+    observers(),
+    stop_on_mode_change(false),
+    snapshot(nullptr),
+    cost_model(nullptr),
+    pc_counters(nullptr),
+    tape_mem(dynamic_cast<MemoryIface&>(_tape)),
+    sv_regs(*this),
+    sv_map(_name + ".sv_map", tape_mem)
     {
-        tl = cfg.Get("tl");
-        if ((tl < 10 || tl > 127) && tl != 9999)
+        if (!ValidConfig("tl", cfg.Get("tl")))
             error("Bad TL value in configuration");
+        tl = cfg.Get("tl");
         if (tl != 9999)
             tl = (my_uint128_t)1 << tl;
-        tw = cfg.Get("tw");
-        if (tw < 8 || tw > 128 || (tw & 0x7))
+        if (!ValidConfig("tw", cfg.Get("tw")))
             error("Bad TW value in configuration");
+        tw = cfg.Get("tw");
         tape_mask = (my_uint128_t(1) << tw) - 1;
         assert(tape_mask != 0);
-        nm = cfg.Get("nm");
-        if (nm != 2 && nm != 3)
+        if (!ValidConfig("nm", cfg.Get("nm")))
             error("Bad NM value in configuration");
-        sd = cfg.Get("sd");
-        if (sd == 0)
+        nm = cfg.Get("nm");
+        if (!ValidConfig("sd", cfg.Get("sd")))
             error("Bad SD value in configuration");
-        il = cfg.Get("il");
-        if (il < 32)
+        sd = cfg.Get("sd");
+        if (!ValidConfig("il", cfg.Get("il")))
             error("Bad IL value in configuration");
+        il = cfg.Get("il");
         call_stack.resize(this->sd);
+        inactive_call_stack.resize(this->sd);
+        sv_map.AddMapping(sv_regs, sv_regs_base, SupervisorRegs::Count);
+    }
+    
+    /* RETURN: true if the value of a configuration key is allowed, TL as
+     * the power of two of the tape length or 9999 */
+    static bool ValidConfig(const std::string &key, my_uint128_t val) {
+        if (key == "tl")
+            return (val >= 10 && val <= 127) || val == 9999;
+        if (key == "tw")
+            return val >= 8 && val <= 128 && !(val & 0x7);
+        if (key == "nm")
+            return val == 2 || val == 3;
+        if (key == "sd")
+            return val != 0;
+        if (key == "il")
+            return val >= 32;
+        return false;
     }
     
     /* RETURN: [steps, cycles] actually done 
      * [1, 1] - all ok,
      * [1, >1] - ok, but a long instruction encountered
      * [0, 1] - processor disabled
+     * [0, 0] - input is not available, retry after it arrives
      * [0, >1] - unused currently
      */
     steps_cycles_t ExecuteOneStep();
     
     /* IN: maximum steps to do 
-       RETURN: [steps, cycles] actually done */
+       RETURN: [steps, cycles] actually done. 
+       Stops early when the processor halts or waits for input, and
+       optionally after the processor mode changes. */
     steps_cycles_t Execute(step_t max_steps);
+    
+    processor_mode_t GetMode() const { return sr.mode; }
+    step_t StepsDone() const { return steps_done; }
+    cycle_t CyclesDone() const { return cycles_done; }
+    uint64_t Violations() const { return violations; }
+    uint64_t SupervisorEntries() const { return supervisor_entries; }
+    
+    /* Call stacks are allocated for SD entries up front */
+    virtual size_t HostBytes() const {
+        return (call_stack.capacity() + inactive_call_stack.capacity()) * 
+               sizeof(address_t) + 
+               observers.capacity() * sizeof(ExecutionObserverIface*);
+    }
+    
+    /* Of the current mode, only entries below SP are meaningful */
+    const std::vector<address_t>& CallStack() const { return call_stack; }
+    
+    void AddObserver(ExecutionObserverIface &o) { observers.push_back(&o); }
+    void SetStopOnModeChange(bool stop) { stop_on_mode_change = stop; }
+    void SetCostModel(CostModel *m) { cost_model = m; }
+    CostModel* GetCostModel() const { return cost_model; }
+    
+    /* IN: array of two vectors, for application and supervisor mode, or 
+     * nullptr. Cheaper than an observer: no record, no virtual call. */
+    void SetPcCounters(std::vector<pc_counter_t> *counters) { 
+        pc_counters = counters; 
+    }
+    
+    /* IN: where to keep the current position, or nullptr */
+    void SetSnapshot(guest_snapshot_t *s) { snapshot = s; }
+    
+    /* Tape memory as given to the processor, wrappers included */
+    MemoryIface& TapeView() { return tape_mem; }
+    
+    /* Make a device visible in supervisor tape space */
+    void AddMapping(MappedDeviceIface &dev, address_t start, address_t length) {
+        sv_map.AddMapping(dev, start, length);
+    }
+    bool IsWaitingForInput() const { return waiting_input; }
 
     void ProcessViolation(uint8_t opc, uint8_t tap);
     void ReturnToApplicationMode();
@@ -164,6 +341,12 @@ public:
     };
     
     virtual void SetRegister(const std::string &name, const my_uint128_t &val);
+    
+    /* Complete architectural state including saved registers, the 
+     * guest-visible counters and the call stack, for checkpoints. 
+     * Tape contents are not included. */
+    void SaveState(std::ostream &out) const;
+    void RestoreState(std::istream &in);
 }; //BfCpu
 
 #endif // BOFSIM_H_
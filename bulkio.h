@@ -0,0 +1,164 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef BULKIO_H_
+#define BULKIO_H_
+
+#include <fstream>
+#include <string>
+#include <algorithm>
+#include <cstdint>
+
+#include "inttypes.h"
+#include "object.h"
+#include "memory.h"
+#include "addrmap.h"
+#include "log.h"
+
+/* Block transfers between tape and a host file, for supervisor programs.
+ * Every register is one cell; multi-byte values are split into byte lanes,
+ * least significant byte first, so that they can be set with TW = 8.
+ *
+ * offset  register
+ * 0       CMD    - write 1 to load LEN cells from file position POS to tape
+ *                  starting at ADDR, write 2 to store them to the file. 
+ *                  POS advances by LEN. Reads as 0.
+ * 1       STATUS - 0 if the last command succeeded, 1 otherwise
+ * 2-5     ADDR
+ * 6-9     LEN
+ * 10-13   POS
+ *
+ * Cells ADDR..ADDR+LEN-1 must lie within the tape length and POS+LEN must 
+ * fit into 32 bits, otherwise the command fails without touching anything.
+ */
+class BulkIODev: public SimObject, public MappedDeviceIface {
+    MemoryIface &ram;
+    const address_t tape_length;
+    std::fstream file;
+    uint8_t regs[14];
+    
+    uint32_t Get32(address_t offset) const {
+        return  (uint32_t)regs[offset]             | 
+               ((uint32_t)regs[offset + 1] <<  8)  |
+               ((uint32_t)regs[offset + 2] << 16)  |
+               ((uint32_t)regs[offset + 3] << 24);
+    }
+    
+    void Set32(address_t offset, uint32_t val) {
+        for (int i = 0; i < 4; i++)
+            regs[offset + i] = (val >> (8 * i)) & 0xff;
+    }
+    
+    bool Transfer(bool load) {
+        const address_t addr = Get32(Addr);
+        const uint32_t len = Get32(Len);
+        const uint32_t pos = Get32(Pos);
+        if (len > tape_length || addr > tape_length - len)
+            return false;
+        if ((uint64_t)pos + len > UINT32_MAX)
+            return false;
+        file.clear();
+        char buf[4096]; // the guest chooses LEN, do not allocate by it
+        if (load) {
+            file.seekg(0, std::ios::end);
+            if (!file || (uint64_t)file.tellg() < (uint64_t)pos + len)
+                return false;
+            file.seekg(pos);
+            for (uint32_t done = 0; done < len; ) {
+                uint32_t n = std::min<uint32_t>(sizeof(buf), len - done);
+                file.read(buf, n);
+                if (file.gcount() != (std::streamsize)n)
+                    return false;
+                for (uint32_t i = 0; i < n; i++)
+                    ram.Write(addr + done + i, (uint8_t)buf[i]);
+                done += n;
+            }
+        } else {
+            file.seekp(pos);
+            for (uint32_t done = 0; done < len; ) {
+                uint32_t n = std::min<uint32_t>(sizeof(buf), len - done);
+                for (uint32_t i = 0; i < n; i++)
+                    buf[i] = (char)ram.Read(addr + done + i);
+                file.write(buf, n);
+                if (!file)
+                    return false;
+                done += n;
+            }
+            file.flush();
+            if (!file)
+                return false;
+        }
+        Set32(Pos, pos + len);
+        return true;
+    }
+
+public:
+    enum {
+        Cmd = 0,
+        Status = 1,
+        Addr = 2,
+        Len = 6,
+        Pos = 10,
+        Count = 14
+    };
+    enum {
+        CmdLoad = 1,
+        CmdStore = 2
+    };
+    
+    /* IN: tape as the processor sees it and its length in cells */
+    BulkIODev(const std::string _name, MemoryIface &_ram, 
+              address_t _tape_length, const std::string &filename): 
+        SimObject(_name), ram(_ram), tape_length(_tape_length), file(), 
+        regs()
+    {
+        file.open(filename, std::ios::in | std::ios::out | std::ios::binary);
+        if (!file.is_open()) // does not exist yet
+            file.open(filename, std::ios::in | std::ios::out | 
+                                std::ios::trunc | std::ios::binary);
+        if (!file.is_open())
+            error(std::string("Cannot open bulk I/O file ") + filename);
+    }
+    
+    virtual my_uint128_t Read(address_t offset) {
+        return offset == Cmd ? 0 : regs[offset];
+    }
+    
+    virtual void Write(address_t offset, my_uint128_t val) {
+        if (offset != Cmd) {
+            if (offset != Status)
+                regs[offset] = (uint8_t)val;
+            return;
+        }
+        if (val == CmdLoad || val == CmdStore)
+            regs[Status] = Transfer(val == CmdLoad) ? 0 : 1;
+        else
+            regs[Status] = 1;
+    }
+};
+
+#endif // BULKIO_H_
@@ -49,14 +49,6 @@ public:
     
 }; // SimObject
 
-class IfaceMapping{
-
-public:
-    template<Size> error_t ReadData(address_t addr, Size &result) = 0;
-    
-    error_t AddMapping (SimObject &obj, address_t start, address_t length) = 0;
-}
-
 typedef (*EventHandler)(SimObject obj, void* data); // FIXME data must be better typed
 
 // TODO abstract this away
@@ -0,0 +1,193 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef COSTMODEL_H_
+#define COSTMODEL_H_
+
+#include <string>
+#include <algorithm>
+#include <vector>
+#include <map>
+#include <iostream>
+
+#include "inttypes.h"
+#include "object.h"
+#include "config.h"
+#include "bofsim.h"
+
+/* Cycles charged for each retired step, for estimating the performance of
+ * a hardware implementation. Without any keys it reproduces the flat
+ * model: one cycle per instruction or skipped character, none for
+ * comments.
+ *
+ * Keys, all optional:
+ *   plus minus right left open close out in halt - cycles per instruction;
+ *   nop     - comment characters;
+ *   skip    - any character passed over while looking for a bracket;
+ *   branch  - extra for a taken ']' and for a return to application mode;
+ *   sventry - extra for a violation that enters supervisor mode;
+ *   io      - extra for '.' and for ',' that got data;
+ *   tape_lines, tape_line, tape_hit, tape_miss - if tape_lines is set,
+ *             every instruction touching a cell also pays tape_hit or
+ *             tape_miss according to a direct-mapped cache of tape_lines
+ *             lines of tape_line cells each.
+ */
+class CostModel: public SimObject {
+    Configuration cfg; // as given, for cache keys
+    cycle_t ops[256];
+    cycle_t skip;
+    cycle_t branch;
+    cycle_t sventry;
+    cycle_t io;
+    cycle_t tape_hit;
+    cycle_t tape_miss;
+    address_t tape_line;
+    std::vector<address_t> tags; // line number + 1, 0 for an empty line
+    
+    cycle_t Key(const std::string &key, cycle_t def) const {
+        auto it = cfg.cfg.find(key);
+        return it == cfg.cfg.end() ? def : (cycle_t)it->second;
+    }
+    
+    /* Cycles to reach a tape cell through the modeled cache */
+    cycle_t TapeAccess(address_t addr) {
+        address_t line = addr / tape_line;
+        address_t &tag = tags[line % tags.size()];
+        if (tag == line + 1)
+            return tape_hit;
+        tag = line + 1;
+        return tape_miss;
+    }
+    
+public:
+    static bool KnownKey(const std::string &key) {
+        static const char* known[] = {
+            "plus", "minus", "right", "left", "open", "close", "out", "in",
+            "halt", "nop", "skip", "branch", "sventry", "io", 
+            "tape_lines", "tape_line", "tape_hit", "tape_miss"
+        };
+        for (auto k: known)
+            if (key == k)
+                return true;
+        return false;
+    }
+    
+    CostModel(const std::string &_name, const Configuration &_cfg): 
+        SimObject(_name), cfg(_cfg), tags() {
+        for (auto &kv: cfg.cfg)
+            if (!KnownKey(kv.first))
+                error(std::string("Unknown cost model key ") + kv.first);
+        cycle_t nop = Key("nop", 0);
+        for (auto &c: ops)
+            c = nop;
+        ops['+'] = Key("plus", 1);
+        ops['-'] = Key("minus", 1);
+        ops['>'] = Key("right", 1);
+        ops['<'] = Key("left", 1);
+        ops['['] = Key("open", 1);
+        ops[']'] = Key("close", 1);
+        ops['.'] = Key("out", 1);
+        ops[','] = Key("in", 1);
+        ops['\0'] = Key("halt", 1);
+        skip = Key("skip", 1);
+        branch = Key("branch", 0);
+        sventry = Key("sventry", 0);
+        io = Key("io", 0);
+        tape_hit = Key("tape_hit", 0);
+        tape_miss = Key("tape_miss", 0);
+        tape_line = Key("tape_line", 1);
+        if (tape_line == 0)
+            error("Bad tape_line value in cost model");
+        tags.resize(Key("tape_lines", 0));
+    }
+    
+    const Configuration& GetConfig() const { return cfg; }
+    
+    /* Forget the cached tape lines */
+    void Reset() { std::fill(tags.begin(), tags.end(), 0); }
+    
+    /* Cached tape lines, so that a resumed run pays the same cycles */
+    void SaveState(std::ostream &out) const {
+        out << tags.size();
+        for (auto t: tags)
+            out << ' ' << t;
+        out << '\n';
+    }
+    
+    void RestoreState(std::istream &in) {
+        size_t count{0};
+        if (!(in >> count) || count != tags.size())
+            error("Bad cost model state");
+        for (auto &t: tags)
+            in >> t;
+        if (!in)
+            error("Bad cost model state");
+    }
+    
+    /* IN: what the step did and in which mode it started */
+    cycle_t Cycles(uint8_t opcode, ExecuteResult res, 
+                   processor_mode_t mode, address_t tp) {
+        cycle_t c = res == ExecuteResult::Skipping && 
+                    opcode != '[' && opcode != ']' ? skip : ops[opcode];
+        bool touches_tape = false;
+        switch (opcode) {
+        case '+': case '-': case '[': case ']':
+            touches_tape = true;
+            break;
+        case '.': case ',':
+            touches_tape = res != ExecuteResult::Skipping;
+            c += touches_tape ? io : 0;
+            break;
+        case '>': case '<': // the cell goes to SR on violation
+            touches_tape = res == ExecuteResult::Violation;
+            break;
+        default:
+            break;
+        }
+        if (res == ExecuteResult::ControlFlow)
+            c += branch;
+        else if (res == ExecuteResult::Violation && mode == ApplicationMode)
+            c += sventry;
+        if (touches_tape && !tags.empty() && 
+            (res != ExecuteResult::Skipping || opcode == '[' || 
+             opcode == ']'))
+            c += TapeAccess(tp);
+        return c;
+    }
+    
+    /* Stable description of the configuration for cache keys */
+    std::string Signature() const {
+        std::map<std::string, my_uint128_t> sorted(cfg.cfg.begin(), 
+                                                   cfg.cfg.end());
+        std::string sig;
+        for (auto &kv: sorted)
+            sig += kv.first + "=" + std::to_string(kv.second) + ";";
+        return sig;
+    }
+};
+
+#endif // COSTMODEL_H_
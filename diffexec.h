@@ -0,0 +1,242 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef DIFFEXEC_H_
+#define DIFFEXEC_H_
+
+#include <string>
+#include <sstream>
+#include <memory>
+#include <algorithm>
+
+#include "inttypes.h"
+#include "object.h"
+#include "memory.h"
+#include "iodev.h"
+#include "bofsim.h"
+#include "fold.h"
+#include "progen.h"
+
+/* IO device with fixed input, which blocks when it is exhausted,
+ * and recorded output */
+class ScriptedIO: public SimObject, public IOIface {
+    std::string in;
+    size_t pos;
+public:
+    std::string out;
+    ScriptedIO(const std::string _name, const std::string &_in): 
+        SimObject(_name), in(_in), pos(0), out() {};
+    virtual my_uint128_t Read() {
+        my_uint128_t val{0};
+        if (!TryRead(val))
+            error("Input is exhausted");
+        return val;
+    }
+    virtual bool TryRead(my_uint128_t &val) {
+        if (pos == in.size())
+            return false;
+        val = (uint8_t)in[pos++];
+        return true;
+    }
+    virtual void Write(my_uint128_t val) { out.push_back((char)val); }
+};
+
+/* A complete system started from reset with a given program */
+class DiffMachine: public SimObject {
+public:
+    const random_program_t &program;
+    Memory tape;
+    Memory acode;
+    Memory scode;
+    ScriptedIO io;
+    BfCpu cpu;
+    step_t steps; // done by engines so far
+    
+    DiffMachine(const std::string _name, const random_program_t &_program):
+        SimObject(_name), program(_program),
+        tape(_name + ".tape"), acode(_name + ".ainstr"), 
+        scode(_name + ".sinstr"), io(_name + ".io", _program.input),
+        cpu(_name + ".cpu", _program.cfg, tape, acode, scode, io),
+        steps(0)
+    {
+        /* Terminating zero is part of the image, it halts the program */
+        acode.LoadRaw(program.acode.c_str(), program.acode.size() + 1);
+        scode.LoadRaw(program.scode.c_str(), program.scode.size() + 1);
+        if (program.tape.size())
+            tape.LoadRaw(program.tape.data(), program.tape.size());
+    }
+    
+    /* Architectural state: registers, call stack, tape and output so far */
+    std::string State() const {
+        std::ostringstream s;
+        cpu.SaveState(s);
+        std::string t(tape.Dump(), tape.Size());
+        t.erase(t.find_last_not_of('\0') + 1); // unwritten cells are zeros
+        s << "tape " << t.size() << ' ' << t << "\noutput " 
+          << io.out.size() << ' ' << io.out << '\n';
+        return s.str();
+    }
+};
+
+/* A way to advance a machine. The reference engine executes one step at
+ * a time with ExecuteOneStep(); every faster engine must give exactly 
+ * the same architectural state after the same number of steps. */
+class EngineIface {
+public:
+    virtual std::string Name() const = 0;
+    /* Advance by up to steps; fewer only if halted or blocked on input */
+    virtual step_t Run(DiffMachine &m, step_t steps) = 0;
+    
+    step_t Advance(DiffMachine &m, step_t steps) {
+        step_t done = Run(m, steps);
+        m.steps += done;
+        return done;
+    }
+};
+
+class StepEngine: public EngineIface {
+public:
+    virtual std::string Name() const { return "step"; }
+    virtual step_t Run(DiffMachine &m, step_t steps) {
+        step_t done = 0;
+        while (done < steps && m.cpu.ExecuteOneStep().first)
+            done++;
+        return done;
+    }
+};
+
+class BatchEngine: public EngineIface {
+public:
+    virtual std::string Name() const { return "batch"; }
+    virtual step_t Run(DiffMachine &m, step_t steps) {
+        return m.cpu.Execute(steps).first;
+    }
+};
+
+/* Resumes from a folded prefix on the first call if it fits */
+class FoldEngine: public EngineIface {
+    step_t budget;
+public:
+    FoldEngine(step_t _budget = 1 << 16): budget(_budget) {};
+    virtual std::string Name() const { return "fold"; }
+    virtual step_t Run(DiffMachine &m, step_t steps) {
+        step_t done = 0;
+        if (m.steps == 0) {
+            OutputFolder folder("fold", "", std::min(budget, steps));
+            folded_prefix_t prefix = folder.Evaluate(m.program.cfg, m.acode, 
+                                                     m.scode, m.tape);
+            if (prefix.steps) {
+                OutputFolder::Apply(prefix, m.cpu, m.tape, m.io);
+                done = prefix.steps;
+            }
+        }
+        return done + m.cpu.Execute(steps - done).first;
+    }
+};
+
+struct divergence_t {
+    bool found;
+    step_t step;       // first step after which the states differ
+    std::string what;
+    std::string reference;
+    std::string candidate;
+};
+
+/* Runs a program on the reference and on a candidate engine, comparing 
+ * architectural state every checkpoint steps. On a mismatch both are 
+ * replayed from reset and compared after every step of the last interval
+ * to find the first divergent step. */
+class DifferentialHarness: public SimObject {
+    step_t max_steps;
+    step_t checkpoint;
+    
+    static bool Compare(DiffMachine &ref, step_t ref_steps, 
+                        DiffMachine &cand, step_t cand_steps, 
+                        step_t at, divergence_t &d) {
+        std::string rs = ref.State(), cs = cand.State();
+        if (ref_steps == cand_steps && rs == cs)
+            return true;
+        d.found = true;
+        d.step = at;
+        d.what = ref_steps != cand_steps ? "step count" : "state";
+        d.reference = std::to_string(ref_steps) + " steps\n" + rs;
+        d.candidate = std::to_string(cand_steps) + " steps\n" + cs;
+        return false;
+    }
+    
+    divergence_t Localize(const random_program_t &p, EngineIface &engine,
+                          step_t from, step_t to) {
+        StepEngine ref_engine;
+        DiffMachine ref("ref", p), cand("cand", p);
+        divergence_t d = {false, 0, "", "", ""};
+        /* Reproduce the candidate's history up to the last good checkpoint */
+        for (step_t done = 0; done < from; ) {
+            step_t n = std::min(checkpoint, from - done);
+            ref_engine.Advance(ref, n);
+            engine.Advance(cand, n);
+            done += n;
+        }
+        for (step_t s = from; s < to; s++) {
+            step_t r = ref_engine.Advance(ref, 1);
+            step_t c = engine.Advance(cand, 1);
+            if (!Compare(ref, r, cand, c, s + 1, d))
+                return d;
+        }
+        /* Only visible at the checkpoint granularity */
+        d.found = true;
+        d.step = to;
+        d.what = "state at checkpoint, not in single steps";
+        return d;
+    }
+    
+public:
+    DifferentialHarness(const std::string _name, step_t _max_steps = 100000,
+                        step_t _checkpoint = 1000):
+        SimObject(_name), max_steps(_max_steps), 
+        checkpoint(_checkpoint ? _checkpoint : 1) {};
+    
+    divergence_t Run(const random_program_t &p, EngineIface &engine) {
+        StepEngine ref_engine;
+        DiffMachine ref("ref", p), cand("cand", p);
+        divergence_t d = {false, 0, "", "", ""};
+        step_t done = 0;
+        while (done < max_steps) {
+            step_t n = std::min(checkpoint, max_steps - done);
+            step_t r = ref_engine.Advance(ref, n);
+            step_t c = engine.Advance(cand, n);
+            if (!Compare(ref, r, cand, c, done + r, d))
+                return checkpoint > 1 ? Localize(p, engine, done, done + n) 
+                                      : d;
+            done += r;
+            if (r < n) // halted or out of input
+                break;
+        }
+        return d;
+    }
+};
+
+#endif // DIFFEXEC_H_
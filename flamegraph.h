@@ -0,0 +1,75 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef FLAMEGRAPH_H_
+#define FLAMEGRAPH_H_
+
+#include <string>
+#include <map>
+#include <ostream>
+
+#include "inttypes.h"
+#include "object.h"
+#include "bofsim.h"
+#include "log.h"
+
+/* Samples the guest "stack" every interval steps: the mode, PCs of the 
+ * loop heads on the call stack and the current PC. Samples are written as
+ * folded stacks, one "frame;frame;frame count" line per distinct stack, 
+ * which is what flamegraph tools take as input. Sampling by step count
+ * makes the result deterministic. */
+class StackSampler: public SimObject, public ExecutionObserverIface {
+    const BfCpu &cpu;
+    step_t interval;
+    step_t countdown;
+    std::map<std::string, uint64_t> stacks;
+    
+public:
+    StackSampler(const std::string _name, const BfCpu &_cpu, 
+                 step_t _interval):
+        SimObject(_name), cpu(_cpu), 
+        interval(_interval ? _interval : 1), countdown(interval), stacks() {};
+    
+    virtual void OnStep(const step_record_t &rec) {
+        if (--countdown)
+            return;
+        countdown = interval;
+        std::string stack(rec.mode == SupervisorMode ? "sup" : "app");
+        const std::vector<address_t> &call_stack = cpu.CallStack();
+        for (address_t i = 0; i < rec.sp && i < call_stack.size(); i++)
+            stack += ";loop_pc" + std::to_string(call_stack[i]);
+        stack += ";pc" + std::to_string(rec.pc);
+        stacks[stack]++;
+    }
+    
+    void Report(std::ostream &out) const {
+        for (auto &s: stacks)
+            out << s.first << ' ' << s.second << '\n';
+    }
+};
+
+#endif // FLAMEGRAPH_H_
@@ -0,0 +1,243 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef FOLD_H_
+#define FOLD_H_
+
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <map>
+#include <memory>
+#include <cstdio>
+
+#include "inttypes.h"
+#include "object.h"
+#include "config.h"
+#include "memory.h"
+#include "iodev.h"
+#include "bofsim.h"
+#include "costmodel.h"
+
+/* IO device for partial evaluation: keeps the output, never has input */
+class RecordingIO: public SimObject, public IOIface {
+public:
+    std::string out;
+    RecordingIO(const std::string _name): SimObject(_name), out() {};
+    virtual my_uint128_t Read() {
+        error("Input is not available during partial evaluation");
+        return 0;
+    }
+    virtual bool TryRead(my_uint128_t &val) { return false; }
+    virtual void Write(my_uint128_t val) { out.push_back((char)val); }
+};
+
+/* Result of running a program from reset up to its first input */
+struct folded_prefix_t {
+    step_t steps;
+    cycle_t cycles;
+    std::string output;
+    std::string cpu_state; // as done by BfCpu::SaveState()
+    std::string cost_state; // as done by CostModel::SaveState(), if any
+    std::string tape;
+};
+
+/* Partial evaluation of input-independent program prefixes. 
+ * The program is run from reset until the first ',' or until the step 
+ * budget runs out; its output and final state are saved in a cache 
+ * directory under a hash of everything they depend on. A later run emits 
+ * the output with one write and resumes from the saved state.
+ */
+class OutputFolder: public SimObject {
+    std::string cache_dir;
+    step_t budget;
+    const CostModel *cost; // cycles of the prefix are cached too
+    
+    static void HashBytes(uint64_t &h, const char *data, size_t len) {
+        for (size_t i = 0; i < len; i++) { // FNV-1a
+            h ^= (uint8_t)data[i];
+            h *= 0x100000001b3ULL;
+        }
+    }
+    
+    static void HashString(uint64_t &h, const char *data, size_t size) {
+        uint64_t len = size;
+        HashBytes(h, (const char*)&len, sizeof(len));
+        if (size)
+            HashBytes(h, data, size);
+    }
+    
+    static void HashString(uint64_t &h, const std::string &s) {
+        HashString(h, s.data(), s.size());
+    }
+    
+    static void WriteString(std::ostream &out, const std::string &s) {
+        out << s.size() << '\n';
+        out.write(s.data(), s.size());
+    }
+    
+    static bool ReadString(std::istream &in, std::string &s) {
+        size_t len{0};
+        if (!(in >> len) || in.get() != '\n')
+            return false;
+        s.resize(len);
+        in.read(&s[0], len);
+        return (size_t)in.gcount() == len;
+    }
+    
+    std::string CacheFile(uint64_t key) const {
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.fold", (unsigned long long)key);
+        return cache_dir + "/" + name;
+    }
+
+public:
+    OutputFolder(const std::string _name, const std::string &_cache_dir,
+                 step_t _budget, const CostModel *_cost = nullptr):
+        SimObject(_name), cache_dir(_cache_dir), budget(_budget), 
+        cost(_cost) {};
+    
+    /* Key over program images, configuration and the budget itself */
+    uint64_t Key(const Configuration &cfg, const MemoryIface &acode,
+                 const MemoryIface &scode, const MemoryIface &tape) const {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        HashString(h, "bofsim-fold-4");
+        HashString(h, acode.Dump(), acode.Size());
+        HashString(h, scode.Dump(), scode.Size());
+        HashString(h, tape.Dump(), tape.Size());
+        std::map<std::string, my_uint128_t> sorted(cfg.cfg.begin(), 
+                                                   cfg.cfg.end());
+        for (auto &kv: sorted) {
+            HashString(h, kv.first);
+            HashString(h, std::to_string(kv.second));
+        }
+        HashString(h, std::to_string(budget));
+        if (cost)
+            HashString(h, cost->Signature());
+        return h;
+    }
+    
+    folded_prefix_t Evaluate(const Configuration &cfg, Memory &acode, 
+                             Memory &scode, const MemoryIface &tape) {
+        Memory tape_copy("fold.tape");
+        if (tape.Size())
+            tape_copy.LoadRaw(tape.Dump(), tape.Size());
+        RecordingIO rec("fold.io");
+        BfCpu cpu("fold.cpu", cfg, tape_copy, acode, scode, rec);
+        std::unique_ptr<CostModel> prefix_cost;
+        if (cost) {
+            prefix_cost.reset(new CostModel("fold.cost", cost->GetConfig()));
+            cpu.SetCostModel(prefix_cost.get());
+        }
+        
+        folded_prefix_t result;
+        steps_cycles_t done = cpu.Execute(budget);
+        result.steps = done.first;
+        result.cycles = done.second;
+        result.output.swap(rec.out);
+        std::ostringstream state;
+        cpu.SaveState(state);
+        result.cpu_state = state.str();
+        if (prefix_cost) {
+            std::ostringstream cost_state;
+            prefix_cost->SaveState(cost_state);
+            result.cost_state = cost_state.str();
+        }
+        if (tape_copy.Size())
+            result.tape.assign(tape_copy.Dump(), tape_copy.Size());
+        return result;
+    }
+    
+    bool Load(uint64_t key, folded_prefix_t &result) const {
+        std::ifstream in(CacheFile(key), std::ios::binary);
+        std::string magic;
+        uint64_t saved_key{0};
+        if (!(in >> magic >> std::hex >> saved_key >> std::dec) || 
+            magic != "bofsim-fold" || saved_key != key)
+            return false;
+        return in >> result.steps >> result.cycles && 
+               ReadString(in, result.output) &&
+               ReadString(in, result.cpu_state) &&
+               ReadString(in, result.cost_state) &&
+               ReadString(in, result.tape);
+    }
+    
+    void Store(uint64_t key, const folded_prefix_t &prefix) {
+        std::string name = CacheFile(key);
+        std::string tmp_name = name + ".tmp";
+        {
+            std::ofstream out(tmp_name, std::ios::binary | std::ios::trunc);
+            out << "bofsim-fold " << std::hex << key << std::dec << '\n'
+                << prefix.steps << ' ' << prefix.cycles << ' ';
+            WriteString(out, prefix.output);
+            WriteString(out, prefix.cpu_state);
+            WriteString(out, prefix.cost_state);
+            WriteString(out, prefix.tape);
+            if (!out) {
+                info(1, std::string("Cannot write ") + tmp_name);
+                return;
+            }
+        }
+        // Readers never see a partially written file
+        if (std::rename(tmp_name.c_str(), name.c_str()) != 0)
+            info(1, std::string("Cannot write ") + name);
+    }
+    
+    /* Get the prefix from cache or evaluate and cache it */
+    folded_prefix_t Fold(const Configuration &cfg, Memory &acode,
+                         Memory &scode, const MemoryIface &tape) {
+        uint64_t key = Key(cfg, acode, scode, tape);
+        folded_prefix_t result;
+        if (Load(key, result)) {
+            info(2, "Folded prefix is found in cache");
+            return result;
+        }
+        result = Evaluate(cfg, acode, scode, tape);
+        Store(key, result);
+        return result;
+    }
+    
+    /* Bring the system to the state after the prefix, output and the 
+     * processor's cost model state included */
+    static void Apply(const folded_prefix_t &prefix, BfCpu &cpu, 
+                      MemoryIface &tape, IOIface &io) {
+        if (prefix.tape.size())
+            tape.LoadRaw(prefix.tape.data(), prefix.tape.size());
+        std::istringstream state(prefix.cpu_state);
+        cpu.RestoreState(state);
+        CostModel *cost = cpu.GetCostModel();
+        if (cost && prefix.cost_state.size()) {
+            std::istringstream cost_state(prefix.cost_state);
+            cost->RestoreState(cost_state);
+        }
+        if (prefix.output.size())
+            io.WriteBlock(prefix.output.data(), prefix.output.size());
+    }
+};
+
+#endif // FOLD_H_
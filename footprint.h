@@ -0,0 +1,80 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef FOOTPRINT_H_
+#define FOOTPRINT_H_
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <ostream>
+#include <iomanip>
+
+#include "object.h"
+
+/* Host memory held by the components of a simulation, side by side with
+ * the resident set size of the process as the kernel sees it */
+class FootprintReport: public SimObject {
+    std::vector<std::pair<std::string, const FootprintIface*>> parts;
+    
+public:
+    FootprintReport(const std::string _name): SimObject(_name), parts() {};
+    
+    void Add(const std::string &part_name, const FootprintIface &part) {
+        parts.push_back(std::make_pair(part_name, &part));
+    }
+    
+    /* A "Vm..." field of /proc/self/status in bytes, 0 if unknown */
+    static size_t ProcStatusBytes(const std::string &field) {
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.compare(0, field.size() + 1, field + ":") == 0)
+                return std::stoull(line.substr(field.size() + 1)) * 1024;
+        }
+        return 0;
+    }
+    
+    void Report(std::ostream &out) const {
+        size_t total = 0;
+        out << "Memory footprint, bytes:\n";
+        for (auto &p: parts) {
+            size_t bytes = p.second->HostBytes();
+            total += bytes;
+            out << "  " << std::left << std::setw(20) << p.first 
+                << std::right << std::setw(14) << bytes << '\n';
+        }
+        out << "  " << std::left << std::setw(20) << "components total" 
+            << std::right << std::setw(14) << total << '\n'
+            << "  " << std::left << std::setw(20) << "RSS" 
+            << std::right << std::setw(14) << ProcStatusBytes("VmRSS") << '\n'
+            << "  " << std::left << std::setw(20) << "peak RSS" 
+            << std::right << std::setw(14) << ProcStatusBytes("VmHWM") << '\n';
+    }
+};
+
+#endif // FOOTPRINT_H_
@@ -0,0 +1,259 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef HEATMAP_H_
+#define HEATMAP_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <ostream>
+#include <algorithm>
+
+#include "inttypes.h"
+#include "object.h"
+#include "memory.h"
+#include "bofsim.h"
+#include "log.h"
+
+/* Tape seen through a recorder of accesses. Reads and writes are counted 
+ * per block of cells (a cache line or a page) and collected per interval
+ * of steps, which gives a heatmap of tape use over time and the working 
+ * set size of every interval. Give it to BfCpu instead of the tape and 
+ * attach it as an observer to mark the intervals. Once max_intervals are
+ * kept, neighbouring intervals are merged pairwise and the following ones
+ * are twice as long, so memory stays bounded on long runs. */
+class TapeHeatmap: public MemoryIface, public SimObject, 
+                   public ExecutionObserverIface, public FootprintIface {
+    struct counts_t {
+        uint64_t reads;
+        uint64_t writes;
+    };
+    struct interval_t {
+        step_t first_step;
+        uint64_t reads;
+        uint64_t writes;
+        std::map<address_t, counts_t> blocks; // touched ones only
+    };
+    
+    MemoryIface &tape;
+    const address_t block_size;
+    const size_t max_intervals;
+    step_t span; // steps per interval, doubles on every merge
+    step_t countdown;
+    step_t steps;
+    std::unordered_map<address_t, counts_t> current;
+    std::vector<interval_t> intervals;
+    address_t highest; // cell
+    bool touched;
+    
+    void CloseInterval() {
+        interval_t iv = {steps - (span - countdown), 0, 0, {}};
+        for (auto &b: current) {
+            iv.reads += b.second.reads;
+            iv.writes += b.second.writes;
+            iv.blocks[b.first] = b.second;
+        }
+        current.clear();
+        intervals.push_back(iv);
+        if (intervals.size() >= max_intervals)
+            MergeIntervals();
+    }
+    
+    /* Halve the number of intervals by merging neighbours */
+    void MergeIntervals() {
+        size_t kept = 0;
+        for (size_t i = 0; i < intervals.size(); i += 2, kept++) {
+            interval_t iv = std::move(intervals[i]);
+            if (i + 1 < intervals.size()) {
+                const interval_t &next = intervals[i + 1];
+                iv.reads += next.reads;
+                iv.writes += next.writes;
+                for (auto &b: next.blocks) {
+                    counts_t &c = iv.blocks[b.first];
+                    c.reads += b.second.reads;
+                    c.writes += b.second.writes;
+                }
+            }
+            intervals[kept] = std::move(iv);
+        }
+        intervals.resize(kept);
+        span *= 2;
+    }
+    
+    inline void Touch(address_t addr) {
+        if (addr > highest || !touched)
+            highest = addr;
+        touched = true;
+    }
+    
+public:
+    TapeHeatmap(const std::string _name, MemoryIface &_tape, 
+                address_t _block_size = 64, step_t _interval = 100000,
+                size_t _max_intervals = 4096):
+        SimObject(_name), tape(_tape), 
+        block_size(_block_size ? _block_size : 1), 
+        max_intervals(std::max<size_t>(2, _max_intervals)),
+        span(_interval ? _interval : 1), countdown(span), steps(0),
+        current(), intervals(), highest(0), touched(false) {};
+    
+    virtual my_uint128_t Read(address_t addr) {
+        current[addr / block_size].reads++;
+        Touch(addr);
+        return tape.Read(addr);
+    }
+    
+    virtual void Write(address_t addr, my_uint128_t val) {
+        current[addr / block_size].writes++;
+        Touch(addr);
+        tape.Write(addr, val);
+    }
+    
+    /* Every loaded cell counts as written */
+    virtual void LoadRaw(const char* buf, size_t len) { 
+        for (address_t addr = 0; addr < len; addr += block_size)
+            current[addr / block_size].writes += 
+                std::min<address_t>(block_size, len - addr);
+        if (len)
+            Touch(len - 1);
+        tape.LoadRaw(buf, len); 
+    }
+    virtual const char* Dump() const { return tape.Dump(); }
+    virtual size_t Size() const { return tape.Size(); }
+    
+    virtual void OnStep(const step_record_t &rec) {
+        steps++;
+        if (--countdown)
+            return;
+        CloseInterval();
+        countdown = span;
+    }
+    
+    /* Call at the end of the run to account the last partial interval */
+    void Finish() {
+        if (countdown != span || !current.empty())
+            CloseInterval();
+        countdown = span;
+    }
+    
+    size_t Intervals() const { return intervals.size(); }
+    
+    /* Steps in every interval but maybe the last one */
+    step_t Span() const { return span; }
+    
+    /* Hash and tree nodes are taken as the entry plus three pointers */
+    virtual size_t HostBytes() const {
+        const size_t node = sizeof(std::pair<address_t, counts_t>) + 
+                            3 * sizeof(void*);
+        size_t bytes = intervals.capacity() * sizeof(interval_t) + 
+                       current.size() * node + 
+                       current.bucket_count() * sizeof(void*);
+        for (auto &iv: intervals)
+            bytes += iv.blocks.size() * node;
+        return bytes;
+    }
+    
+    /* Distinct blocks touched in the interval */
+    size_t WorkingSet(size_t i) const { return intervals.at(i).blocks.size(); }
+    
+    /* Distinct blocks touched during the whole run */
+    size_t TotalWorkingSet() const {
+        std::map<address_t, bool> all;
+        for (auto &iv: intervals)
+            for (auto &b: iv.blocks)
+                all[b.first] = true;
+        return all.size();
+    }
+    
+    /* One line per interval: its steps, accesses and working set, then
+     * accesses per block for every block touched during the run */
+    void ReportCsv(std::ostream &out) const {
+        std::map<address_t, bool> all;
+        for (auto &iv: intervals)
+            for (auto &b: iv.blocks)
+                all[b.first] = true;
+        out << "interval,first_step,reads,writes,working_set_blocks,"
+               "working_set_bytes";
+        for (auto &b: all)
+            out << ",block_" << b.first * block_size;
+        out << '\n';
+        for (size_t i = 0; i < intervals.size(); i++) {
+            const interval_t &iv = intervals[i];
+            out << i << ',' << iv.first_step << ',' << iv.reads << ',' 
+                << iv.writes << ',' << iv.blocks.size() << ',' 
+                << iv.blocks.size() * block_size;
+            for (auto &b: all) {
+                auto it = iv.blocks.find(b.first);
+                out << ',' << (it == iv.blocks.end() ? 0 : 
+                               it->second.reads + it->second.writes);
+            }
+            out << '\n';
+        }
+    }
+    
+    /* Heatmap of at most width columns of blocks and rows of intervals,
+     * merged as needed, and working set figures */
+    void Report(std::ostream &out, size_t width = 64, size_t rows = 32) const {
+        static const char shades[] = " .:-=+*#%@";
+        const address_t blocks = touched ? highest / block_size + 1 : 0;
+        const address_t per_col = std::max<address_t>(1, 
+                                        (blocks + width - 1) / width);
+        const size_t per_row = std::max<size_t>(1, 
+                                        (intervals.size() + rows - 1) / rows);
+        size_t max_ws = 0;
+        for (auto &iv: intervals)
+            max_ws = std::max(max_ws, iv.blocks.size());
+        
+        out << "Tape heatmap: " << block_size << "-cell blocks, " 
+            << per_col << " block(s) per column, " << span * per_row 
+            << " steps per row\n";
+        std::vector<std::vector<uint64_t>> grid;
+        uint64_t hottest = 0;
+        for (size_t i = 0; i < intervals.size(); i += per_row) {
+            std::vector<uint64_t> row((blocks + per_col - 1) / per_col);
+            for (size_t j = i; j < i + per_row && j < intervals.size(); j++)
+                for (auto &b: intervals[j].blocks)
+                    row[b.first / per_col] += b.second.reads + b.second.writes;
+            for (uint64_t v: row)
+                hottest = std::max(hottest, v);
+            grid.push_back(row);
+        }
+        for (auto &row: grid) {
+            out << '|';
+            for (uint64_t v: row) 
+                out << shades[(v * 9 + hottest - 1) / hottest];
+            out << "|\n";
+        }
+        out << "Highest cell touched " << (touched ? highest : 0) 
+            << ", working set per interval up to " << max_ws << " blocks ("
+            << max_ws * block_size << " cells), whole run " 
+            << TotalWorkingSet() << " blocks\n";
+    }
+};
+
+#endif // HEATMAP_H_
@@ -0,0 +1,217 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef HOSTPROF_H_
+#define HOSTPROF_H_
+
+#include <vector>
+#include <map>
+#include <string>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+#include <csignal>
+
+#include <sys/time.h>
+
+#include "inttypes.h"
+#include "object.h"
+#include "memory.h"
+#include "bofsim.h"
+#include "log.h"
+
+/* Statistical profiler driven by host CPU time. ITIMER_PROF delivers 
+ * SIGPROF every interval of host CPU time; the handler copies the guest 
+ * snapshot the processor keeps once Attach()'ed into a preallocated 
+ * buffer. The timer counts CPU time of the whole process, helper threads
+ * block SIGPROF so that it is delivered to the simulation thread. Unlike step 
+ * counts of PcProfiler, samples are weighted by how long the host spent 
+ * at a guest instruction, which matters for I/O, wide cells and skipping.
+ * Only one instance can be active at a time. */
+class HostTimeProfiler: public SimObject, public FootprintIface {
+    struct sample_t {
+        address_t pc;
+        address_t tp;
+        uint8_t mode;
+        uint8_t skipping;
+    };
+    
+    guest_snapshot_t snapshot;
+    const unsigned interval_us;
+    std::vector<sample_t> samples; // never resized while the timer runs
+    volatile size_t taken;
+    volatile size_t dropped;
+    struct sigaction old_action;
+    bool running;
+    
+    static HostTimeProfiler*& active() { 
+        static HostTimeProfiler *p = nullptr; 
+        return p; 
+    }
+    
+    static void OnSignal(int) {
+        HostTimeProfiler *p = active();
+        if (!p)
+            return;
+        if (p->taken >= p->samples.size()) {
+            p->dropped = p->dropped + 1;
+            return;
+        }
+        sample_t &s = p->samples[p->taken];
+        s.pc = p->snapshot.pc;
+        s.tp = p->snapshot.tp;
+        s.mode = p->snapshot.mode;
+        s.skipping = p->snapshot.skipping;
+        p->taken = p->taken + 1;
+    }
+    
+    static const char* ModeName(int mode) {
+        return mode == ApplicationMode ? "app" : 
+               mode == SupervisorMode ? "sup" : "halt";
+    }
+    
+    static double Share(size_t part, size_t total) {
+        return total ? 100.0 * part / total : 0.0;
+    }
+    
+public:
+    HostTimeProfiler(const std::string _name, unsigned _interval_us = 1000, 
+                     size_t capacity = 1 << 20):
+        SimObject(_name), snapshot(),
+        interval_us(_interval_us ? _interval_us : 1),
+        samples(capacity), taken(0), dropped(0), old_action(), 
+        running(false) {};
+    
+    virtual ~HostTimeProfiler() { Stop(); }
+    
+    void Attach(BfCpu &cpu) { cpu.SetSnapshot(&snapshot); }
+    void Detach(BfCpu &cpu) { cpu.SetSnapshot(nullptr); }
+    
+    void Start() {
+        if (running)
+            return;
+        if (active())
+            error("Another host time profiler is already running");
+        active() = this;
+        struct sigaction sa = {};
+        sa.sa_handler = OnSignal;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(SIGPROF, &sa, &old_action) < 0) {
+            active() = nullptr;
+            error("Cannot install SIGPROF handler");
+        }
+        struct itimerval it = {};
+        it.it_interval.tv_sec = interval_us / 1000000;
+        it.it_interval.tv_usec = interval_us % 1000000;
+        it.it_value = it.it_interval;
+        if (setitimer(ITIMER_PROF, &it, nullptr) < 0) {
+            sigaction(SIGPROF, &old_action, nullptr);
+            active() = nullptr;
+            error("Cannot start profiling timer");
+        }
+        running = true;
+    }
+    
+    void Stop() {
+        if (!running)
+            return;
+        struct itimerval it = {};
+        setitimer(ITIMER_PROF, &it, nullptr);
+        sigaction(SIGPROF, &old_action, nullptr);
+        active() = nullptr;
+        running = false;
+    }
+    
+    size_t Samples() const { return taken; }
+    
+    virtual size_t HostBytes() const { 
+        return samples.capacity() * sizeof(sample_t); 
+    }
+    size_t Dropped() const { return dropped; }
+    
+    /* Call after Stop() */
+    void Report(std::ostream &out, const MemoryIface &acode, 
+                const MemoryIface &scode, size_t top = 20) const {
+        const MemoryIface *code[2] = {&acode, &scode};
+        typedef std::pair<int, address_t> where_t; // mode, pc
+        std::map<where_t, size_t> per_pc;
+        std::map<address_t, size_t> per_tp;
+        size_t per_mode[3] = {0, 0, 0};
+        size_t skipping = 0;
+        for (size_t i = 0; i < taken; i++) {
+            const sample_t &s = samples[i];
+            per_pc[where_t(s.mode, s.pc)]++;
+            per_tp[s.tp]++;
+            per_mode[std::min<int>(s.mode, 2)]++;
+            skipping += s.skipping;
+        }
+        const std::ios::fmtflags flags = out.flags();
+        const std::streamsize precision = out.precision();
+        out << "Host time profile: " << taken << " samples every " 
+            << interval_us << " us of host CPU time";
+        if (dropped)
+            out << ", " << dropped << " dropped (buffer full)";
+        out << "\n  application " << std::fixed << std::setprecision(2)
+            << Share(per_mode[ApplicationMode], taken) << "%, supervisor " 
+            << Share(per_mode[SupervisorMode], taken) << "%, halted " 
+            << Share(per_mode[2], taken) << "%, skipping " 
+            << Share(skipping, taken) << "%\n";
+        
+        std::vector<std::pair<size_t, where_t>> pcs;
+        for (auto &p: per_pc)
+            pcs.push_back(std::make_pair(p.second, p.first));
+        std::sort(pcs.rbegin(), pcs.rend());
+        out << "\nHottest instructions by host time:\n"
+            << "   share  mode     pc  op     samples\n";
+        for (size_t i = 0; i < pcs.size() && i < top; i++) {
+            int mode = pcs[i].second.first;
+            address_t pc = pcs[i].second.second;
+            char op = mode <= SupervisorMode && code[mode]->Size() > pc ? 
+                      code[mode]->Dump()[pc] : ' ';
+            out << std::setw(7) << Share(pcs[i].first, taken) << "%  " 
+                << ModeName(mode) << std::setw(7) << pc << "  " 
+                << std::setw(2) << (op >= 0x20 && op < 0x7f ? op : ' ')
+                << std::setw(12) << pcs[i].first << '\n';
+        }
+        
+        std::vector<std::pair<size_t, address_t>> tps;
+        for (auto &p: per_tp)
+            tps.push_back(std::make_pair(p.second, p.first));
+        std::sort(tps.rbegin(), tps.rend());
+        out << "\nHottest tape cells by host time:\n"
+            << "   share      tp     samples\n";
+        for (size_t i = 0; i < tps.size() && i < top; i++)
+            out << std::setw(7) << Share(tps[i].first, taken) << "%  " 
+                << std::setw(6) << tps[i].second 
+                << std::setw(12) << tps[i].first << '\n';
+        out.flags(flags);
+        out.precision(precision);
+    }
+};
+
+#endif // HOSTPROF_H_
@@ -29,6 +29,17 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <iostream>
 #include <fstream>
+#include <cstdlib>
+#include <cerrno>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <poll.h>
+#include <cstring>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#endif
 
 #include "inttypes.h"
 #include "object.h"
@@ -38,13 +49,165 @@ class IOIface {
 public:
     virtual my_uint128_t Read() = 0;
     virtual void Write(my_uint128_t val) = 0;
+    virtual void Flush() {};
+    /* Output of a prepared block, same as Write() for every byte */
+    virtual void WriteBlock(const char *data, size_t len) {
+        for (size_t i = 0; i < len; i++)
+            Write((uint8_t)data[i]);
+    }
+    /* Non-blocking input. RETURN: false if no data is available now,
+     * val is not changed then. Devices that cannot tell just block. */
+    virtual bool TryRead(my_uint128_t &val) {
+        val = Read();
+        return true;
+    }
+};
+
+#ifdef __linux__
+/* Output path for the case when stdout is a pipe. Output is collected in
+ * two page-aligned halves, each as large as the pipe itself. A full half is
+ * handed to the kernel with vmsplice(), so its pages are referenced by the
+ * pipe instead of being copied. Once the other half has been spliced
+ * completely, the pipe cannot hold anything else, so the first half has
+ * been consumed by the reader and can be refilled.
+ * Partial halves (final flush) are written with plain write() which copies.
+ * The pipe belongs to whoever gave it to us, so its size is not changed;
+ * if it is non-blocking, output waits until there is room.
+ */
+class PipeWriter: public Log {
+    int fd;
+    char *buf;   // two halves of half_size bytes each
+    size_t half_size;
+    size_t fill; // bytes used in the active half
+    int active;  // index of the half being filled
+    
+    /* RETURN: true if the caller should retry after a failed write */
+    bool Retry(const char *what) {
+        if (errno == EINTR)
+            return true;
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            struct pollfd pfd = {};
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            while (poll(&pfd, 1, -1) < 0 && errno == EINTR)
+                ;
+            return true;
+        }
+        error(std::string(what) + " to output pipe failed: " + 
+              strerror(errno));
+        return false;
+    }
+    
+    void WriteAll(const char *data, size_t len) {
+        while (len > 0) {
+            ssize_t res = ::write(fd, data, len);
+            if (res < 0) {
+                if (Retry("Write")) continue;
+                return;
+            }
+            data += res;
+            len -= res;
+        }
+    }
+    
+    void SpliceActive() {
+        struct iovec iov;
+        iov.iov_base = buf + active * half_size;
+        iov.iov_len = half_size;
+        while (iov.iov_len > 0) {
+            ssize_t res = vmsplice(fd, &iov, 1, 0);
+            if (res < 0) {
+                if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
+                    Retry("Splice");
+                    continue;
+                }
+                // Kernel refused to splice, copy the rest and stop trying
+                WriteAll((const char*)iov.iov_base, iov.iov_len);
+                return;
+            }
+            iov.iov_base = (char*)iov.iov_base + res;
+            iov.iov_len -= res;
+        }
+    }
+
+public:
+    PipeWriter(): fd(-1), buf(nullptr), half_size(0), fill(0), active(0) {};
+    ~PipeWriter() {
+        try {
+            Close();
+        } catch (std::exception &) {} // already reported
+    }
+    
+    /* Returns true if fd is a pipe and zero-copy output was set up */
+    bool Open(int _fd) {
+        struct stat st;
+        if (fstat(_fd, &st) != 0 || !S_ISFIFO(st.st_mode))
+            return false;
+        int pipe_size = fcntl(_fd, F_GETPIPE_SZ);
+        long page = sysconf(_SC_PAGESIZE);
+        if (pipe_size <= 0 || page <= 0 || pipe_size % page)
+            return false;
+        void *mem = nullptr;
+        if (posix_memalign(&mem, page, 2 * (size_t)pipe_size))
+            return false;
+        fd = _fd;
+        buf = (char*)mem;
+        half_size = pipe_size;
+        fill = 0;
+        active = 0;
+        return true;
+    }
+    
+    bool IsOpen() const { return buf != nullptr; }
+    size_t BufferBytes() const { return buf ? 2 * half_size : 0; }
+    
+    inline void Put(char v) {
+        buf[active * half_size + fill] = v;
+        if (++fill == half_size) {
+            SpliceActive();
+            active ^= 1;
+            fill = 0;
+        }
+    }
+    
+    void Flush() {
+        if (!buf || !fill) return;
+        WriteAll(buf + active * half_size, fill);
+        fill = 0;
+    }
+    
+    void PutBlock(const char *data, size_t len) {
+        Flush();
+        WriteAll(data, len);
+    }
+    
+    void Close() {
+        if (!buf) return;
+        try {
+            Flush();
+        } catch (std::exception &) {
+            free(buf);
+            buf = nullptr;
+            throw;
+        }
+        free(buf);
+        buf = nullptr;
+    }
 };
+#endif // __linux__
 
-class IODev: public SimObject, public IOIface {
+class IODev: public SimObject, public IOIface, public FootprintIface {
     std::ifstream fcin;
     std::ofstream fcout;
     std::istream &cin;
     std::ostream &cout;
+#ifdef __linux__
+    PipeWriter pipeout; // used instead of cout when stdout is a pipe
+#endif
+    int in_fd; // host descriptor behind cin, -1 if unknown
+    bool nonblocking;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
     
 public:
     IODev(const std::string _name): 
@@ -52,8 +215,17 @@ public:
         fcin(),
         fcout(),
         cin(std::cin),
-        cout(std::cout)
-        {};
+        cout(std::cout),
+        in_fd(0),
+        nonblocking(false),
+        bytes_in(0),
+        bytes_out(0)
+        {
+#ifdef __linux__
+            std::cout.flush(); // keep whatever was printed before in order
+            pipeout.Open(STDOUT_FILENO);
+#endif
+        };
     IODev(const std::string _name,
           const std::string _inname,
           const std::string _outname
@@ -61,25 +233,127 @@ public:
        fcin(_inname),
        fcout(_outname, std::ios::out | std::ios::trunc),
        cin(fcin),
-       cout(fcout)
+       cout(fcout),
+       in_fd(-1),
+       nonblocking(false),
+       bytes_in(0),
+       bytes_out(0)
        {};
 
     virtual ~IODev() {
+        try {
+            Flush();
+#ifdef __linux__
+            pipeout.Close();
+#endif
+        } catch (std::exception &) {} // already reported
         if (fcin.is_open())  fcin.close();
         if (fcout.is_open()) fcout.close();
     }
         
     virtual my_uint128_t Read() {
+        Flush(); // let an interactive user see the prompt
         char val;
         cin.get(val);
+        bytes_in++;
         return val;
     }
     
+    /* In non-blocking mode input bypasses cin and is read from the host
+     * descriptor directly, so switch it before the first Read(). 
+     * Descriptor flags are left alone: they are shared with whoever else
+     * holds the same open file, e.g. stdout on a terminal. Instead every
+     * read is preceded by a readiness check. */
+    void SetNonBlockingInput(bool enable) {
+        if (enable == nonblocking)
+            return;
+#ifdef __linux__
+        if (in_fd < 0)
+            error("Non-blocking input needs a host descriptor");
+        nonblocking = enable;
+#else
+        error("Non-blocking input is not supported on this host");
+#endif
+    }
+    
+    /* Buffers of the host streams themselves are not known */
+    virtual size_t HostBytes() const {
+#ifdef __linux__
+        return pipeout.BufferBytes();
+#else
+        return 0;
+#endif
+    }
+    
+    /* Guest I/O volume, for statistics */
+    uint64_t BytesIn() const { return bytes_in; }
+    uint64_t BytesOut() const { return bytes_out; }
+    
+    /* Descriptor to watch for readiness, -1 if there is none */
+    int InputFd() const { return in_fd; }
+    
+    virtual bool TryRead(my_uint128_t &val) {
+        if (!nonblocking)
+            return IOIface::TryRead(val);
+#ifdef __linux__
+        Flush();
+        struct pollfd pfd = {};
+        pfd.fd = in_fd;
+        pfd.events = POLLIN;
+        int ready;
+        do {
+            ready = poll(&pfd, 1, 0);
+        } while (ready < 0 && errno == EINTR);
+        if (ready == 0)
+            return false;
+        char c;
+        ssize_t res;
+        do {
+            res = ::read(in_fd, &c, 1);
+        } while (res < 0 && errno == EINTR);
+        if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return false;
+        val = res == 1 ? c : 0; // EOF and errors read as zero
+        bytes_in++;
+#endif
+        return true;
+    }
+    
     virtual void Write(my_uint128_t val) {
         // TODO parsametrize this to output either ASCII or hex or dec etc
         char v = static_cast<char>(val);
+        bytes_out++;
+#ifdef __linux__
+        if (pipeout.IsOpen()) {
+            pipeout.Put(v);
+            return;
+        }
+#endif
         cout << v;
-    }    
+    }
+    
+    virtual void WriteBlock(const char *data, size_t len) {
+        bytes_out += len;
+#ifdef __linux__
+        if (pipeout.IsOpen()) {
+            std::cout.flush();
+            pipeout.PutBlock(data, len);
+            return;
+        }
+#endif
+        cout.write(data, len);
+    }
+    
+    virtual void Flush() {
+#ifdef __linux__
+        if (pipeout.IsOpen()) {
+            std::cout.flush();
+            pipeout.Flush();
+            return;
+        }
+#endif
+        cout.flush();
+    }
 };
 
 #endif // IODEV_H_
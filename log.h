@@ -31,12 +31,41 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <string>
 #include <exception>
 
+/* Messages with level above LOG_MAX_LEVEL are compiled out. 
+ * Level 4 messages are done for every simulated instruction;
+ * build with -DLOG_MAX_LEVEL=4 to be able to see them. */
+#ifndef LOG_MAX_LEVEL
+#define LOG_MAX_LEVEL 3
+#endif
+
+/* Log a message built from stream insertions, e.g. 
+ * LOG_INFO(2, "Loop to PC = " << pc);
+ * Nothing is evaluated unless the level is enabled. */
+#define LOG_INFO(level, msg) do { \
+        if ((level) <= LOG_MAX_LEVEL && Log::Enabled(level)) \
+            Log::Sink() << msg << '\n'; \
+    } while (0)
+
 class Log {
-    // TODO add log levels
+    /* Both are constant-initialized, so accessing them is a plain load */
+    static int& threshold() { static int level = 1; return level; }
+    static std::ostream*& sink() { static std::ostream *out = &std::cerr; return out; }
 public:
-    void info(int level, const std::string msg) { std::cout << msg << std::endl;}
+    /* Messages with level above the threshold are not printed */
+    static void SetThreshold(int level) { threshold() = level; }
+    static int Threshold() { return threshold(); }
+    static inline bool Enabled(int level) { return level <= threshold(); }
+    
+    /* Log output is kept separate from guest output on stdout */
+    static void SetSink(std::ostream &out) { sink() = &out; }
+    static std::ostream& Sink() { return *sink(); }
+    
+    void info(int level, const std::string msg) { 
+        if (level <= LOG_MAX_LEVEL && Enabled(level))
+            Sink() << msg << '\n';
+    }
     void error(const std::string msg) { 
-        std::cout << msg << std::endl;
+        Sink() << msg << std::endl;
         std::exception e; // TODO invent something more fancy
         throw e;
     }
@@ -0,0 +1,224 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef LOOPPROF_H_
+#define LOOPPROF_H_
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <unordered_map>
+#include <algorithm>
+#include <cstring>
+
+#include "inttypes.h"
+#include "object.h"
+#include "bofsim.h"
+#include "log.h"
+
+/* Per-loop statistics: entries, iterations, trip count histogram and steps
+ * attributed through loop nesting. Loops are followed with a shadow copy 
+ * of what '[' and ']' do to the call stack and to SK. */
+class LoopProfiler: public SimObject, public ExecutionObserverIface {
+    static const int hist_buckets = 65; // 0, 1, 2-3, 4-7, ... trips
+    
+    struct loop_stats_t {
+        int mode;
+        address_t start, end; // PCs of '[' and ']', end is 0 if unknown
+        uint64_t entries;
+        uint64_t iterations;
+        step_t inclusive_steps;
+        step_t exclusive_steps;
+        uint64_t hist[hist_buckets];
+    };
+    
+    struct frame_t {
+        size_t loop; // index in loops
+        step_t entry_step;
+        uint64_t trips;
+        step_t child_steps; // inclusive steps of nested loop instances
+    };
+    
+    /* Shadow state for each mode that executes code */
+    struct shadow_t {
+        std::vector<frame_t> stack;
+        uint64_t skip;      // SK
+        bool back_edge;     // last ']' jumped back, next '[' continues
+    };
+    
+    std::vector<loop_stats_t> loops;
+    std::unordered_map<uint64_t, size_t> index; // (pc, mode) -> loops
+    shadow_t shadow[2];
+    step_t last_step;
+    step_t first_step;
+    
+    static int Bucket(uint64_t trips) {
+        int b = 0;
+        while (trips) {
+            b++;
+            trips >>= 1;
+        }
+        return b;
+    }
+    
+    size_t Loop(int mode, address_t pc) {
+        uint64_t key = (pc << 1) | mode;
+        auto it = index.find(key);
+        if (it != index.end())
+            return it->second;
+        loop_stats_t l;
+        memset(&l, 0, sizeof(l));
+        l.mode = mode;
+        l.start = pc;
+        loops.push_back(l);
+        index[key] = loops.size() - 1;
+        return loops.size() - 1;
+    }
+    
+    /* Loop instance ends at step, complete tells if it is a real exit */
+    void Pop(shadow_t &sh, step_t step, bool complete) {
+        frame_t f = sh.stack.back();
+        sh.stack.pop_back();
+        loop_stats_t &l = loops[f.loop];
+        step_t inclusive = step - f.entry_step + 1;
+        l.inclusive_steps += inclusive;
+        l.exclusive_steps += inclusive - f.child_steps;
+        if (complete)
+            l.hist[Bucket(f.trips)]++;
+        if (!sh.stack.empty())
+            sh.stack.back().child_steps += inclusive;
+    }
+
+public:
+    LoopProfiler(const std::string _name): 
+        SimObject(_name), loops(), index(), last_step(0), first_step(0)
+    {
+        for (auto &sh: shadow) {
+            sh.skip = 0;
+            sh.back_edge = false;
+        }
+    }
+    
+    virtual void OnStep(const step_record_t &rec) {
+        if (!first_step)
+            first_step = rec.step;
+        last_step = rec.step;
+        if (rec.mode > SupervisorMode)
+            return;
+        shadow_t &sh = shadow[rec.mode];
+        ExecuteResult res = (ExecuteResult)rec.result;
+        
+        if (res == ExecuteResult::Violation) {
+            if (rec.mode == ApplicationMode) { // supervisor starts afresh
+                shadow_t &sv = shadow[SupervisorMode];
+                while (!sv.stack.empty())
+                    Pop(sv, rec.step, false);
+                sv.skip = 0;
+                sv.back_edge = false;
+            }
+            return;
+        }
+        
+        if (rec.opcode == '[') {
+            if (sh.skip) {
+                sh.skip++;
+            } else if (res == ExecuteResult::Skipping) { // zero trips
+                size_t l = Loop(rec.mode, rec.pc);
+                loops[l].entries++;
+                loops[l].hist[0]++;
+                sh.skip = 1;
+            } else if (sh.back_edge && !sh.stack.empty() &&
+                       loops[sh.stack.back().loop].start == rec.pc) {
+                sh.back_edge = false; // next iteration of the same loop
+            } else {
+                size_t l = Loop(rec.mode, rec.pc);
+                loops[l].entries++;
+                loops[l].iterations++;
+                sh.stack.push_back({l, rec.step, 1, 0});
+            }
+        } else if (rec.opcode == ']') {
+            if (sh.skip) {
+                sh.skip--;
+            } else if (!sh.stack.empty()) {
+                loops[sh.stack.back().loop].end = rec.pc;
+                if (res == ExecuteResult::ControlFlow) {
+                    sh.stack.back().trips++;
+                    loops[sh.stack.back().loop].iterations++;
+                    sh.back_edge = true;
+                } else {
+                    Pop(sh, rec.step, true);
+                }
+            }
+        }
+    }
+    
+    /* Export statistics as JSON. Loops still running are accounted
+     * up to the last step, without their trip counts. */
+    void ReportJson(std::ostream &out) {
+        for (auto &sh: shadow)
+            while (!sh.stack.empty())
+                Pop(sh, last_step, false);
+        std::vector<size_t> order(loops.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+            return loops[a].inclusive_steps > loops[b].inclusive_steps;
+        });
+        
+        out << "{\n  \"total_steps\": " 
+            << (last_step ? last_step - first_step + 1 : 0)
+            << ",\n  \"loops\": [";
+        for (size_t i = 0; i < order.size(); i++) {
+            const loop_stats_t &l = loops[order[i]];
+            out << (i ? "," : "") << "\n    {"
+                << "\"mode\": \"" << (l.mode ? "sup" : "app") << "\", "
+                << "\"start\": " << l.start << ", "
+                << "\"end\": " << (l.end ? std::to_string(l.end) : "null") 
+                << ", "
+                << "\"entries\": " << l.entries << ", "
+                << "\"iterations\": " << l.iterations << ", "
+                << "\"inclusive_steps\": " << l.inclusive_steps << ", "
+                << "\"exclusive_steps\": " << l.exclusive_steps << ", "
+                << "\"trip_histogram\": [";
+            bool first = true;
+            for (int b = 0; b < hist_buckets; b++) {
+                if (!l.hist[b])
+                    continue;
+                uint64_t min = b ? (uint64_t)1 << (b - 1) : 0;
+                uint64_t max = b ? (min << 1) - 1 : 0;
+                out << (first ? "" : ", ") << "{\"min\": " << min 
+                    << ", \"max\": " << max << ", \"count\": " << l.hist[b]
+                    << "}";
+                first = false;
+            }
+            out << "]}";
+        }
+        out << "\n  ]\n}\n";
+    }
+};
+
+#endif // LOOPPROF_H_
@@ -26,10 +26,33 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <iostream>
 #include <cassert>
+#include <memory>
+#include <algorithm>
+#include <csignal>
+#include <chrono>
+#include <vector>
+#include <cstring>
+#include <cctype>
+#include <stdexcept>
+#include <climits>
 
 #include "bofsim.h"
 #include "memory.h"
 #include "iodev.h"
+#include "poller.h"
+#include "bulkio.h"
+#include "fold.h"
+#include "trace.h"
+#include "profile.h"
+#include "loopprof.h"
+#include "perfctr.h"
+#include "flamegraph.h"
+#include "stats.h"
+#include "metrics.h"
+#include "hostprof.h"
+#include "footprint.h"
+#include "heatmap.h"
+#include "costmodel.h"
 #include "optionparser.h"
 
 typedef struct cli_options {
@@ -37,15 +60,64 @@ typedef struct cli_options {
     const char *scode_file;
     const char *acode_file;
     const char *tape_file;    
+    const char *bulkio_file;
+    const char *fold_dir;
+    step_t fold_budget = 10000000;
+    int log_level = 1;
+    const char *log_file;
+    const char *trace_file;
+    size_t trace_size = 65536;
+    bool trace_violations;
+    bool profile;
+    const char *loop_profile_file;
+    bool perf;
+    const char *flamegraph_file;
+    step_t sample_interval = 1000;
+    bool stats;
+    bool stats_json;
+    bool stats_speed; // only steps and time, no observer
+    const char *metrics_socket;
+    const char *metrics_file;
+    unsigned metrics_period = 1000;
+    bool host_profile;
+    bool lean;
+    bool footprint;
+    const char *heatmap_file;
+    address_t heatmap_block = 64;
+    step_t heatmap_interval = 100000;
+    std::vector<std::pair<std::string, my_uint128_t>> cfg_overrides;
+    std::vector<std::pair<std::string, my_uint128_t>> costs;
+    unsigned host_profile_interval = 1000;
+    bool nonblocking_input;
 } cli_options_t;
 
+/* Decimal number taking the whole text. 
+ * Returns false if there is none or it does not fit. */
+static bool parse_number(const std::string &text, uint64_t &value) {
+    if (text.empty() || !isdigit((unsigned char)text[0]))
+        return false;
+    size_t end = 0;
+    try {
+        value = std::stoull(text, &end);
+    } catch (const std::logic_error &) { // invalid_argument, out_of_range
+        return false;
+    }
+    return end == text.size();
+}
+
 /* Parses command-line options, exits program on error. 
  * Returns options on success.
  */
 static cli_options_t parse_argv(int argc, char** argv) {
     cli_options_t result = {};
     /* Parse command line options */
-    enum  optionIndex {UNKNOWN, HELP, STEPS, ACODE, SCODE, TAPE};
+    enum  optionIndex {UNKNOWN, HELP, STEPS, ACODE, SCODE, TAPE, NONBLOCK, BULKIO, 
+                         FOLD, FOLD_BUDGET, LOG_LEVEL, LOG_FILE,
+                         TRACE, TRACE_SIZE, TRACE_VIOLATIONS, PROFILE,
+                         LOOP_PROFILE, PERF, FLAMEGRAPH, SAMPLE_INTERVAL, STATS,
+                         METRICS_SOCKET, METRICS_FILE, METRICS_PERIOD,
+                         HOST_PROFILE, LEAN, FOOTPRINT, CFG, HEATMAP, 
+                         HEATMAP_BLOCK, HEATMAP_INTERVAL, COST};
     const option::Descriptor usage[] = {
         {UNKNOWN, 0, "" , ""     , option::Arg::None, 
                 "Usage: bofsim [--help] [--steps=steps] "
@@ -62,6 +134,83 @@ static cli_options_t parse_argv(int argc, char** argv) {
                 "  --tape,      File with initial tape state." },
         {ACODE,   0, "", "acode", option::Arg::Optional, 
                 "  --scode,     File with application mode program." },
+        {NONBLOCK, 0, "", "nonblock", option::Arg::None, 
+                "  --nonblock   Do not block the host thread on guest input,"
+                " park the CPU until stdin is readable." },
+        {BULKIO,  0, "", "bulkio", option::Arg::Optional, 
+                "  --bulkio,    File for the block transfer device mapped"
+                " in supervisor tape space at 1024." },
+        {FOLD,    0, "", "fold", option::Arg::Optional, 
+                "  --fold,      Cache directory for output of the program"
+                " part that runs before the first input. Not done with"
+                " instrumentation that observes steps, which would miss"
+                " the part." },
+        {FOLD_BUDGET, 0, "", "fold-budget", option::Arg::Optional, 
+                "  --fold-budget  Maximum steps to evaluate for --fold." },
+        {LOG_LEVEL, 0, "", "log-level", option::Arg::Optional, 
+                "  --log-level  Print log messages up to this level (1-4), 0 for none." },
+        {LOG_FILE, 0, "", "log-file", option::Arg::Optional, 
+                "  --log-file   Write log to file instead of stderr." },
+        {TRACE,   0, "", "trace", option::Arg::Optional, 
+                "  --trace      Keep binary trace of last steps, write it to"
+                " file on halt, at exit and on SIGUSR2." },
+        {TRACE_SIZE, 0, "", "trace-size", option::Arg::Optional, 
+                "  --trace-size Number of steps to keep in trace." },
+        {TRACE_VIOLATIONS, 0, "", "trace-violations", option::Arg::None, 
+                "  --trace-violations  Also write trace on every violation." },
+        {PROFILE, 0, "", "profile", option::Arg::None, 
+                "  --profile    Count steps per instruction, print hottest"
+                " instructions and loops to stderr at exit." },
+        {LOOP_PROFILE, 0, "", "loop-profile", option::Arg::Optional, 
+                "  --loop-profile  Write per-loop statistics to file as JSON"
+                " at exit." },
+        {PERF,    0, "", "perf", option::Arg::None, 
+                "  --perf       Count host hardware events per simulated step"
+                " and processor mode, print them to stderr at exit." },
+        {FLAMEGRAPH, 0, "", "flamegraph", option::Arg::Optional, 
+                "  --flamegraph Sample guest loop stacks, write them to file"
+                " as folded stacks at exit." },
+        {SAMPLE_INTERVAL, 0, "", "sample-interval", option::Arg::Optional, 
+                "  --sample-interval  Steps between samples for --flamegraph." },
+        {STATS,   0, "", "stats", option::Arg::Optional, 
+                "  --stats      Print run statistics to stderr at exit and on"
+                " SIGUSR1, --stats=json for machine-readable output,"
+                " --stats=speed for steps and time only, as JSON, without"
+                " slowing the simulation down." },
+        {METRICS_SOCKET, 0, "", "metrics-socket", option::Arg::Optional, 
+                "  --metrics-socket  Serve live counters in Prometheus text"
+                " format on this Unix socket." },
+        {METRICS_FILE, 0, "", "metrics-file", option::Arg::Optional, 
+                "  --metrics-file  Periodically rewrite this file with live"
+                " counters in Prometheus text format." },
+        {METRICS_PERIOD, 0, "", "metrics-period", option::Arg::Optional, 
+                "  --metrics-period  Milliseconds between --metrics-file"
+                " updates." },
+        {HOST_PROFILE, 0, "", "host-profile", option::Arg::Optional, 
+                "  --host-profile  Sample guest PC every given microseconds"
+                " (1000 if omitted) of host CPU time, print hottest"
+                " instructions to stderr at exit." },
+        {LEAN,    0, "", "lean", option::Arg::None, 
+                "  --lean       Do not print loaded images and defaults,"
+                " for short runs where startup time matters, and print"
+                " startup time breakdown." },
+        {FOOTPRINT, 0, "", "footprint", option::Arg::None, 
+                "  --footprint  Print host memory held by every component"
+                " and the process RSS to stderr at exit." },
+        {CFG,     0, "", "cfg", option::Arg::Optional, 
+                "  --cfg        Override a configuration register,"
+                " e.g. --cfg=sd=64. Can be repeated." },
+        {COST,    0, "", "cost", option::Arg::Optional, 
+                "  --cost       Set a cycle cost, e.g. --cost=branch=2."
+                " Can be repeated. Keys are listed in costmodel.h." },
+        {HEATMAP, 0, "", "heatmap", option::Arg::Optional, 
+                "  --heatmap    Count tape accesses per block and interval,"
+                " write them to file as CSV and print a heatmap to stderr"
+                " at exit." },
+        {HEATMAP_BLOCK, 0, "", "heatmap-block", option::Arg::Optional, 
+                "  --heatmap-block  Cells per block for --heatmap." },
+        {HEATMAP_INTERVAL, 0, "", "heatmap-interval", option::Arg::Optional, 
+                "  --heatmap-interval  Steps per interval for --heatmap." },
         {0,0,0,0,0,0}
     };
 
@@ -114,6 +263,259 @@ static cli_options_t parse_argv(int argc, char** argv) {
         }
         result.acode_file = options[ACODE].arg;
     }
+    if (options[BULKIO]) {
+        if (!options[BULKIO].arg) {
+            std::cerr << "Empty bulk I/O file name.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.bulkio_file = options[BULKIO].arg;
+    }
+    if (options[FOLD]) {
+        if (!options[FOLD].arg) {
+            std::cerr << "Empty fold cache directory name.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.fold_dir = options[FOLD].arg;
+    }
+    if (options[FOLD_BUDGET]) {
+        if (!options[FOLD_BUDGET].arg) {
+            std::cerr << "Fold budget cannot be empty.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        uint64_t budget = 0;
+        if (!parse_number(options[FOLD_BUDGET].arg, budget)) {
+            std::cerr << "Fold budget must be a number.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.fold_budget = budget;
+    }
+    if (options[LOG_LEVEL]) {
+        if (!options[LOG_LEVEL].arg) {
+            std::cerr << "Log level cannot be empty.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        uint64_t level = 0;
+        if (!parse_number(options[LOG_LEVEL].arg, level) || level > 4) {
+            std::cerr << "Log level must be a number from 0 to 4.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.log_level = level;
+        if (result.log_level > LOG_MAX_LEVEL)
+            std::cerr << "Log levels above " << LOG_MAX_LEVEL 
+                      << " are not compiled in\n";
+    }
+    if (options[LOG_FILE]) {
+        if (!options[LOG_FILE].arg) {
+            std::cerr << "Empty log file name.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.log_file = options[LOG_FILE].arg;
+    }
+    if (options[TRACE]) {
+        if (!options[TRACE].arg) {
+            std::cerr << "Empty trace file name.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.trace_file = options[TRACE].arg;
+    }
+    if (options[TRACE_SIZE]) {
+        if (!options[TRACE_SIZE].arg) {
+            std::cerr << "Trace size cannot be empty.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        uint64_t size = 0;
+        if (!parse_number(options[TRACE_SIZE].arg, size) || size == 0 ||
+            size > ((uint64_t)1 << 30)) {
+            std::cerr << "Trace size must be a number from 1 to 2^30.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.trace_size = size;
+    }
+    if (options[TRACE_VIOLATIONS])
+        result.trace_violations = true;
+    if (options[PROFILE])
+        result.profile = true;
+    if (options[LOOP_PROFILE]) {
+        if (!options[LOOP_PROFILE].arg) {
+            std::cerr << "Empty loop profile file name.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.loop_profile_file = options[LOOP_PROFILE].arg;
+    }
+    if (options[PERF])
+        result.perf = true;
+    if (options[FLAMEGRAPH]) {
+        if (!options[FLAMEGRAPH].arg) {
+            std::cerr << "Empty flamegraph file name.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.flamegraph_file = options[FLAMEGRAPH].arg;
+    }
+    if (options[SAMPLE_INTERVAL]) {
+        if (!options[SAMPLE_INTERVAL].arg) {
+            std::cerr << "Sample interval cannot be empty.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        uint64_t interval = 0;
+        if (!parse_number(options[SAMPLE_INTERVAL].arg, interval) || 
+            interval == 0) {
+            std::cerr << "Sample interval must be a positive number.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.sample_interval = interval;
+    }
+    if (options[NONBLOCK])
+        result.nonblocking_input = true;
+    if (options[STATS]) {
+        result.stats = true;
+        if (options[STATS].arg) {
+            std::string format(options[STATS].arg);
+            if (format != "json" && format != "speed") {
+                std::cerr << "Unknown statistics format " 
+                          << options[STATS].arg << ".\n";
+                option::printUsage(std::cout, usage);
+                exit(1);
+            }
+            result.stats_json = format == "json";
+            result.stats_speed = format == "speed";
+        }
+    }
+    if (options[METRICS_SOCKET]) {
+        if (!options[METRICS_SOCKET].arg) {
+            std::cerr << "Empty metrics socket name.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.metrics_socket = options[METRICS_SOCKET].arg;
+    }
+    if (options[METRICS_FILE]) {
+        if (!options[METRICS_FILE].arg) {
+            std::cerr << "Empty metrics file name.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.metrics_file = options[METRICS_FILE].arg;
+    }
+    if (options[METRICS_PERIOD]) {
+        if (!options[METRICS_PERIOD].arg) {
+            std::cerr << "Metrics period cannot be empty.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        uint64_t period = 0;
+        if (!parse_number(options[METRICS_PERIOD].arg, period) || 
+            period == 0 || period > UINT_MAX) {
+            std::cerr << "Metrics period must be a positive number.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.metrics_period = period;
+    }
+    if (options[LEAN])
+        result.lean = true;
+    if (options[FOOTPRINT])
+        result.footprint = true;
+    if (options[HEATMAP]) {
+        if (!options[HEATMAP].arg) {
+            std::cerr << "Empty heatmap file name.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.heatmap_file = options[HEATMAP].arg;
+    }
+    if (options[HEATMAP_BLOCK]) {
+        if (!options[HEATMAP_BLOCK].arg) {
+            std::cerr << "Heatmap block size cannot be empty.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        uint64_t block = 0;
+        if (!parse_number(options[HEATMAP_BLOCK].arg, block) || block == 0) {
+            std::cerr << "Heatmap block size must be a positive number.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.heatmap_block = block;
+    }
+    if (options[HEATMAP_INTERVAL]) {
+        if (!options[HEATMAP_INTERVAL].arg) {
+            std::cerr << "Heatmap interval cannot be empty.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        uint64_t interval = 0;
+        if (!parse_number(options[HEATMAP_INTERVAL].arg, interval) || 
+            interval == 0) {
+            std::cerr << "Heatmap interval must be a positive number.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.heatmap_interval = interval;
+    }
+    for (option::Option *opt = options[CFG]; opt; opt = opt->next()) {
+        std::string kv = opt->arg ? opt->arg : "";
+        size_t eq = kv.find('=');
+        std::string key = kv.substr(0, eq);
+        uint64_t value = 0;
+        if (eq == std::string::npos || 
+            !parse_number(kv.substr(eq + 1), value) ||
+            (key != "tl" && key != "tw" && key != "nm" && 
+             key != "sd" && key != "il")) {
+            std::cerr << "Configuration override must be tl, tw, nm, sd"
+                         " or il=number.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        if (!BfCpu::ValidConfig(key, value)) {
+            std::cerr << "Configuration value " << kv << " is out of range.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.cfg_overrides.push_back(std::make_pair(key, value));
+    }
+    for (option::Option *opt = options[COST]; opt; opt = opt->next()) {
+        std::string kv = opt->arg ? opt->arg : "";
+        size_t eq = kv.find('=');
+        std::string key = kv.substr(0, eq);
+        uint64_t value = 0;
+        if (eq == std::string::npos || !CostModel::KnownKey(key)) {
+            std::cerr << "Unknown cycle cost " << kv << ".\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        if (!parse_number(kv.substr(eq + 1), value)) {
+            std::cerr << "Cycle cost " << key << " must be a number.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.costs.push_back(std::make_pair(key, value));
+    }
+    if (options[HOST_PROFILE]) {
+        result.host_profile = true;
+        uint64_t interval = result.host_profile_interval;
+        if (options[HOST_PROFILE].arg && 
+            (!parse_number(options[HOST_PROFILE].arg, interval) || 
+             interval == 0 || interval > UINT_MAX)) {
+            std::cerr << "Host profile interval must be a positive number.\n";
+            option::printUsage(std::cout, usage);
+            exit(1);
+        }
+        result.host_profile_interval = interval;
+    }
     
 //     /* Handle non-positional sarguments */
 //     for (int i = 0; i < parse.nonOptionsCount(); ++i) {
@@ -122,11 +524,74 @@ static cli_options_t parse_argv(int argc, char** argv) {
     return result;
 } // parse_argv()
 
+static volatile sig_atomic_t trace_dump_requested = 0;
+
+static void request_trace_dump(int) {
+    trace_dump_requested = 1;
+}
+
+static volatile sig_atomic_t stats_report_requested = 0;
+
+static void request_stats_report(int) {
+    stats_report_requested = 1;
+}
+
+/* Loads file contents into memory, truncated to limit bytes.
+ * Returns false if the file cannot be read. */
+static bool load_image(const char *file, Memory &mem, my_uint128_t limit,
+                       const char *what, const char *limit_name, bool lean) {
+    std::ifstream in(file, std::ifstream::ate | std::ifstream::binary);
+    std::streamoff size = in.tellg(); // opened at end
+    if (size == -1) {
+        std::cerr << "Cannot determine file length for " << file << std::endl;
+        return false;
+    }
+    if (limit < (my_uint128_t)size) {
+        std::cerr << what << " file size is bigger than configured " 
+                  << limit_name << " " << limit << ", will truncate\n";
+        size = (std::streamoff)limit;
+    }
+    if (size > 0) {
+        std::vector<char> buf(size);
+        in.seekg(0, in.beg);
+        in.read(buf.data(), size);
+        if (in.gcount() != size) {
+            std::cerr << "Cannot read " << file << std::endl;
+            return false;
+        }
+        mem.LoadRaw(buf.data(), size);
+    }
+    if (!lean)
+        std::cerr << what << ":\n" 
+                  << std::string(mem.Dump(), strnlen(mem.Dump(), mem.Size()))
+                  << std::endl;
+    return true;
+}
+
+static double us_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(
+                    std::chrono::steady_clock::now() - start).count();
+}
+
 int main(int argc, char** argv) {
+    const auto start = std::chrono::steady_clock::now();
     cli_options_t r = parse_argv(argc, argv);
+    const double parse_us = us_since(start);
+    
+    /* Set up logging before any object is created */
+    std::ofstream log_stream;
+    if (r.log_file) {
+        log_stream.open(r.log_file, std::ios::out | std::ios::trunc);
+        if (!log_stream.is_open()) {
+            std::cerr << "Cannot open log file " << r.log_file << std::endl;
+            return 1;
+        }
+        Log::SetSink(log_stream);
+    }
+    Log::SetThreshold(r.log_level);
     
     /* Prepare architectural configuration */
-    /* TODO allow to load it from file or command-line */
+    /* TODO allow to load it from file */
     Configuration cpuCfg;
     cpuCfg.cfg = { {"tl", 9999},
                    {"tw", 8},
@@ -134,117 +599,237 @@ int main(int argc, char** argv) {
                    {"sd", 16},
                    {"il", 4096}
     };
+    for (auto &kv: r.cfg_overrides)
+        cpuCfg.Set(kv.first, kv.second);
     
     /* Add Objects */
     Memory tape("tape");
     Memory acodeInstr("ainstr");
     Memory scodeInstr("sinstr");
     IODev  io("io");
-    BfCpu  cpu("cpu", cpuCfg, tape, acodeInstr, scodeInstr, io);
+    std::unique_ptr<TapeHeatmap> heatmap; // sits between the CPU and tape
+    if (r.heatmap_file)
+        heatmap.reset(new TapeHeatmap("heatmap", tape, r.heatmap_block, 
+                                      r.heatmap_interval));
+    BfCpu  cpu("cpu", cpuCfg, 
+               heatmap ? static_cast<SimObject&>(*heatmap) : tape, 
+               acodeInstr, scodeInstr, io);
+    /* Configuration is valid once the processor accepts it */
+    my_uint128_t real_tl = cpuCfg.Get("tl") == 9999 ? 9999: 
+                                    (my_uint128_t)1 << cpuCfg.Get("tl");
+    std::unique_ptr<CostModel> cost;
+    if (!r.costs.empty()) {
+        Configuration costCfg;
+        for (auto &kv: r.costs)
+            costCfg.Set(kv.first, kv.second);
+        cost.reset(new CostModel("cost", costCfg));
+        cpu.SetCostModel(cost.get());
+    }
+    std::unique_ptr<BulkIODev> bulkio;
+    if (r.bulkio_file) {
+        const address_t bulkio_base = 1024;
+        bulkio.reset(new BulkIODev("bulkio", cpu.TapeView(), real_tl, 
+                                   r.bulkio_file));
+        cpu.AddMapping(*bulkio, bulkio_base, BulkIODev::Count);
+    }
 
-    /* Buffer to be used to load Memory's contents */
-    std::streampos bufsize{0};
-    char*  buf = nullptr;
+    const double objects_us = us_since(start);
     
-    /* Load application program data from file */
+    /* Load application program, supervisor program and tape */
     if (not r.acode_file) {
         std::cerr << "Required application code file is not specified!\n";
         return 1;
-    } else {
-        std::ifstream acode_stream(r.acode_file, std::ifstream::ate); // open at end
-        bufsize = acode_stream.tellg(); // get size
-        if (bufsize == -1) {
-            std::cerr << "Cannot determine file length for " 
-                    << r.acode_file << std::endl;
-            return 1;
-        }
-    //     std::cerr << "size = " << bufsize << "\n";
-        acode_stream.seekg(0, acode_stream.beg); // rewind to the beginning
-        // Check if file is longer than instruction memory, warn user if so
-        if (cpuCfg.Get("il") < (my_uint128_t)bufsize) {
-            std::cerr << "Application code file size is bigger than "
-                        " confgured application memory size " << cpuCfg.Get("il") <<
-                        ", will truncate code\n";
-            bufsize = (size_t)cpuCfg.Get("il");
-        }
-        if (bufsize > 0) {
-            buf = new char[bufsize];
-            acode_stream.read(buf, bufsize);
-            assert(acode_stream.tellg() == bufsize);
-            acodeInstr.LoadRaw(buf, bufsize); // not very efficient double buffering
-            delete[] buf;
-        }
-        acode_stream.close();
-        std::cerr << "Acode:\n" << acodeInstr.Dump() << std::endl;
     }
-    
-    /* Load supervisor program data from file */
+    if (!load_image(r.acode_file, acodeInstr, cpuCfg.Get("il"),
+                    "Application code", "application memory size", r.lean))
+        return 1;
     if (not r.scode_file) {
-        std::cerr << "Supervisor code file is not specified, leaving empty\n";
-    } else {
-        std::ifstream scode_stream(r.scode_file, std::ifstream::ate); // open at end
-        bufsize = scode_stream.tellg(); // get size
-        if (bufsize == -1) {
-            std::cerr << "Cannot determine file length for " 
-                    << r.scode_file << std::endl;
-            return 1;
-        }
-    //     std::cerr << "size = " << bufsize << "\n";
-        scode_stream.seekg(0, scode_stream.beg); // rewind to the beginning
-        // Check if file is longer than instruction memory, warn user if so
-        if (cpuCfg.Get("il") < (my_uint128_t)bufsize) {
-            std::cerr << "Supervisor code file size is bigger than "
-                        " confgured supervisor memory size " << cpuCfg.Get("il") <<
-                        ", will truncate code\n";
-            bufsize = (size_t)cpuCfg.Get("il");
-        }
-        if (bufsize > 0) {
-            buf = new char[bufsize];
-            scode_stream.read(buf, bufsize);
-            assert(scode_stream.tellg() == bufsize);
-            scodeInstr.LoadRaw(buf, bufsize); // not very efficient double buffering
-            delete[] buf;
-        }
-        scode_stream.close();
-        std::cerr << "Scode:\n" << scodeInstr.Dump() << std::endl;
+        if (!r.lean)
+            std::cerr << "Supervisor code file is not specified, leaving empty\n";
+    } else if (!load_image(r.scode_file, scodeInstr, cpuCfg.Get("il"), 
+                           "Supervisor code", "supervisor memory size", 
+                           r.lean)) {
+        return 1;
     }
-    
-    /* Load tape data from file */
     if (not r.tape_file) {
-        std::cerr << "Tape file is not specified, leaving empty\n";
-    } else {
-        std::ifstream tape_stream(r.tape_file, std::ifstream::ate); // open at end
-        bufsize = tape_stream.tellg(); // get size
-        if (bufsize == -1) {
-            std::cerr << "Cannot determine file length for " 
-                    << r.tape_file << std::endl;
-            return 1;
-        }
-    //     std::cerr << "size = " << bufsize << "\n";
-        tape_stream.seekg(0, tape_stream.beg); // rewind to the beginning
-        // Check if file is longer than instruction memory, warn user if so
-        my_uint128_t real_tl = cpuCfg.Get("tl") == 9999 ? 9999: 
-                                        (my_uint128_t)1 << cpuCfg.Get("tl");
-        if (real_tl < (my_uint128_t)bufsize) {
-            std::cerr << "Tape file size is bigger than "
-                        " confgured tape length " << real_tl <<
-                        ", will truncate.\n";
-            bufsize = (size_t)real_tl;
-        }
-        if (bufsize > 0) {
-            buf = new char[bufsize];
-            tape_stream.read(buf, bufsize);
-            assert(tape_stream.tellg() == bufsize);
-            tape.LoadRaw(buf, bufsize); // not very efficient double buffering
-            delete[] buf;
-        }
-        tape_stream.close();
-        std::cerr << "Tape:\n" << tape.Dump() << std::endl;
+        if (!r.lean)
+            std::cerr << "Tape file is not specified, leaving empty\n";
+    } else if (!load_image(r.tape_file, tape, real_tl, "Tape", 
+                           "tape length", r.lean)) {
+        return 1;
+    }
+    const double load_us = us_since(start);
+    
+    /* Skip the part of the program that does not depend on input */
+    step_t done = 0;
+    const bool observed = r.trace_file || r.profile || r.loop_profile_file ||
+                          r.flamegraph_file || r.heatmap_file || 
+                          (r.stats && !r.stats_speed);
+    if (r.fold_dir && bulkio) {
+        std::cerr << "Folding is not possible with bulk I/O, disabled\n";
+    } else if (r.fold_dir && observed) {
+        std::cerr << "Folding would hide steps from instrumentation, "
+                     "disabled\n";
+    } else if (r.fold_dir) {
+        OutputFolder folder("folder", r.fold_dir, 
+                            std::min(r.fold_budget, r.steps), cost.get());
+        folded_prefix_t prefix = folder.Fold(cpuCfg, acodeInstr, 
+                                             scodeInstr, tape);
+        OutputFolder::Apply(prefix, cpu, cpu.TapeView(), io);
+        done = prefix.steps;
+    }
+    
+    /* Attach instrumentation */
+    std::unique_ptr<TraceBuffer> trace;
+    if (r.trace_file) {
+        trace.reset(new TraceBuffer("trace", r.trace_file, r.trace_size, 
+                                    r.trace_violations));
+        cpu.AddObserver(*trace);
+        signal(SIGUSR2, request_trace_dump);
+    }
+    std::unique_ptr<PcProfiler> profiler;
+    if (r.profile) {
+        profiler.reset(new PcProfiler("profiler", cpuCfg.Get("il")));
+        profiler->Attach(cpu);
+    }
+    std::unique_ptr<LoopProfiler> loop_profiler;
+    if (r.loop_profile_file) {
+        loop_profiler.reset(new LoopProfiler("loop_profiler"));
+        cpu.AddObserver(*loop_profiler);
+    }
+    std::unique_ptr<StackSampler> sampler;
+    if (r.flamegraph_file) {
+        sampler.reset(new StackSampler("sampler", cpu, r.sample_interval));
+        cpu.AddObserver(*sampler);
+    }
+    if (heatmap)
+        cpu.AddObserver(*heatmap);
+    std::unique_ptr<RunStats> stats;
+    if (r.stats && !r.stats_speed) {
+        stats.reset(new RunStats("stats"));
+        cpu.AddObserver(*stats);
+        signal(SIGUSR1, request_stats_report);
+    }
+    std::unique_ptr<MetricsExporter> metrics;
+    if (r.metrics_socket && r.metrics_file) {
+        std::cerr << "Only one of --metrics-socket and --metrics-file"
+                     " can be used\n";
+        return 1;
+    } else if (r.metrics_socket) {
+        metrics.reset(new MetricsExporter("metrics", 
+                        MetricsExporter::Sink::Socket, r.metrics_socket));
+    } else if (r.metrics_file) {
+        metrics.reset(new MetricsExporter("metrics", 
+                        MetricsExporter::Sink::File, r.metrics_file, 
+                        r.metrics_period));
+    }
+    std::unique_ptr<HostTimeProfiler> host_profiler;
+    if (r.host_profile) {
+        host_profiler.reset(new HostTimeProfiler("host_profiler", 
+                                                 r.host_profile_interval));
+        host_profiler->Attach(cpu);
+        host_profiler->Start();
     }
+    std::unique_ptr<HostPerfCounters> perf;
+    if (r.perf) {
+        perf.reset(new HostPerfCounters("perf"));
+        if (perf->Available())
+            cpu.SetStopOnModeChange(true);
+        else
+            std::cerr << "Host performance counters are not permitted, "
+                         "continuing without them\n";
+    }
+    
     /* Simulate */
-    for (step_t step = 0; step < r.steps; step++) {
-        cpu.ExecuteOneStep();
+    std::unique_ptr<InputPoller> poller; // only if the guest waits for input
+    if (r.nonblocking_input)
+        io.SetNonBlockingInput(true);
+    const step_t chunk = 1 << 20; // how often to look at host requests
+    const double first_step_us = us_since(start);
+    while (done < r.steps) {
+        processor_mode_t mode = cpu.GetMode();
+        if (perf)
+            perf->Begin();
+        step_t steps = cpu.Execute(std::min(chunk, r.steps - done)).first;
+        if (perf)
+            perf->End(mode, steps);
+        done += steps;
+        if (metrics)
+            metrics->Publish(cpu, io);
+        if (trace_dump_requested) {
+            trace_dump_requested = 0;
+            trace->Dump();
+        }
+        if (stats_report_requested && stats) {
+            stats_report_requested = 0;
+            stats->Report(std::cerr, cpu, r.stats_json);
+        }
+        if (cpu.GetMode() == HaltMode)
+            break;
+        if (cpu.IsWaitingForInput()) {
+            if (!poller)
+                poller.reset(new InputPoller("poller"));
+            poller->Park(io.InputFd(), cpu);
+            poller->Wait(-1); // the only guest, nothing else to run meanwhile
+        }
     }
+    const double last_step_us = us_since(start);
+    if (host_profiler)
+        host_profiler->Stop();
+    if (trace)
+        trace->Dump();
+    if (host_profiler)
+        host_profiler->Report(std::cerr, acodeInstr, scodeInstr);
+    if (profiler)
+        profiler->Report(std::cerr, acodeInstr, scodeInstr);
+    if (perf && perf->Available())
+        perf->Report(std::cerr);
+    if (stats)
+        stats->Report(std::cerr, cpu, r.stats_json);
+    if (r.stats_speed)
+        RunStats::ReportSpeed(std::cerr, cpu, last_step_us - first_step_us);
+    if (sampler) {
+        std::ofstream out(r.flamegraph_file, std::ios::out | std::ios::trunc);
+        sampler->Report(out);
+        if (!out)
+            std::cerr << "Cannot write " << r.flamegraph_file << std::endl;
+    }
+    if (heatmap) {
+        heatmap->Finish();
+        heatmap->Report(std::cerr);
+        std::ofstream out(r.heatmap_file, std::ios::out | std::ios::trunc);
+        heatmap->ReportCsv(out);
+        if (!out)
+            std::cerr << "Cannot write " << r.heatmap_file << std::endl;
+    }
+    if (loop_profiler) {
+        std::ofstream out(r.loop_profile_file, std::ios::out | std::ios::trunc);
+        loop_profiler->ReportJson(out);
+        if (!out)
+            std::cerr << "Cannot write " << r.loop_profile_file << std::endl;
+    }
+    if (r.footprint) {
+        FootprintReport footprint("footprint");
+        footprint.Add("tape", tape);
+        footprint.Add("application code", acodeInstr);
+        footprint.Add("supervisor code", scodeInstr);
+        footprint.Add("cpu call stack", cpu);
+        footprint.Add("io buffers", io);
+        if (trace)
+            footprint.Add("trace", *trace);
+        if (profiler)
+            footprint.Add("profiler", *profiler);
+        if (host_profiler)
+            footprint.Add("host profiler", *host_profiler);
+        if (heatmap)
+            footprint.Add("heatmap", *heatmap);
+        footprint.Report(std::cerr);
+    }
+    
+    /* Cumulative times since main() was entered */
+    LOG_INFO(r.lean ? 1 : 2, "Startup, us: options " << parse_us << ", objects " 
+             << objects_us << ", images " << load_us << ", first step "
+             << first_step_us << ", exit " << us_since(start));
     
     return 0;
 }
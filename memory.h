@@ -33,7 +33,6 @@ EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "inttypes.h"
 #include "object.h"
-#include "bofsim.h"
 #include "log.h"
 
 class MemoryIface/*: public SimObject*/ {
@@ -44,12 +43,13 @@ public:
     virtual void Write(address_t addr, my_uint128_t val) = 0;
     virtual void LoadRaw(const char* buf, size_t len) = 0;
     virtual const char* Dump() const = 0;
+    virtual size_t Size() const = 0; // of the data returned by Dump()
 };
 
 // The memory device represent an unbounded array of addressable cells
 // Host memory is allocated lazily (not done currently)
 /* TODO current implementation does not handle large memory sizes */
-class Memory: public MemoryIface, public SimObject {
+class Memory: public MemoryIface, public SimObject, public FootprintIface {
     
     std::vector<char> data;
     
@@ -85,6 +85,14 @@ public:
     virtual const char* Dump() const {
         return data.data();
     }
+    
+    virtual size_t Size() const {
+        return data.size();
+    }
+    
+    virtual size_t HostBytes() const {
+        return data.capacity();
+    }
 };
 
 #endif // MEMORY_H_
@@ -0,0 +1,284 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "inttypes.h"
+#include "object.h"
+#include "bofsim.h"
+#include "iodev.h"
+
+/* Exports current simulation counters in Prometheus text format, either 
+ * served on a Unix domain socket or periodically written to a file.
+ * The simulation thread calls Publish() between chunks of steps; a helper 
+ * thread renders the counters from atomics, so neither side takes a lock 
+ * and a scrape never stops the simulation.
+ */
+class MetricsExporter: public SimObject {
+public:
+    enum class Sink { Socket, File };
+    
+private:
+    std::atomic<uint64_t> steps;
+    std::atomic<uint64_t> cycles;
+    std::atomic<uint64_t> pc;
+    std::atomic<uint64_t> mode;
+    std::atomic<uint64_t> violations;
+    std::atomic<uint64_t> supervisor_entries;
+    std::atomic<uint64_t> bytes_in;
+    std::atomic<uint64_t> bytes_out;
+    std::atomic<bool> waiting_input;
+    std::atomic<double> steps_per_second;
+    std::atomic<bool> stopping;
+    
+    const Sink kind;
+    const std::string path;
+    const unsigned period_ms;
+    int listen_fd;
+    
+    /* Used by the simulation thread only, to compute the rate */
+    std::chrono::steady_clock::time_point last_time;
+    uint64_t last_steps;
+    
+    std::thread server;
+    
+    static uint64_t ResidentBytes() {
+        long pages = 0, resident = 0;
+        FILE *f = fopen("/proc/self/statm", "r");
+        if (!f)
+            return 0;
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(f);
+        return (uint64_t)resident * sysconf(_SC_PAGESIZE);
+    }
+    
+    std::string Render() const {
+        std::ostringstream out;
+        const std::memory_order rlx = std::memory_order_relaxed;
+        out << "# HELP bofsim_steps_total Simulated steps.\n"
+            << "# TYPE bofsim_steps_total counter\n"
+            << "bofsim_steps_total " << steps.load(rlx) << '\n'
+            << "# HELP bofsim_cycles_total Simulated cycles.\n"
+            << "# TYPE bofsim_cycles_total counter\n"
+            << "bofsim_cycles_total " << cycles.load(rlx) << '\n'
+            << "# HELP bofsim_violations_total Guest violations.\n"
+            << "# TYPE bofsim_violations_total counter\n"
+            << "bofsim_violations_total " << violations.load(rlx) << '\n'
+            << "# HELP bofsim_supervisor_entries_total Switches to supervisor mode.\n"
+            << "# TYPE bofsim_supervisor_entries_total counter\n"
+            << "bofsim_supervisor_entries_total " 
+            << supervisor_entries.load(rlx) << '\n'
+            << "# HELP bofsim_io_bytes_total Bytes transferred by the guest.\n"
+            << "# TYPE bofsim_io_bytes_total counter\n"
+            << "bofsim_io_bytes_total{direction=\"in\"} " 
+            << bytes_in.load(rlx) << '\n'
+            << "bofsim_io_bytes_total{direction=\"out\"} " 
+            << bytes_out.load(rlx) << '\n'
+            << "# HELP bofsim_pc Program counter at the last update.\n"
+            << "# TYPE bofsim_pc gauge\n"
+            << "bofsim_pc " << pc.load(rlx) << '\n'
+            << "# HELP bofsim_mode Processor mode (0 application, 1 supervisor,"
+               " 2 halt).\n"
+            << "# TYPE bofsim_mode gauge\n"
+            << "bofsim_mode " << mode.load(rlx) << '\n'
+            << "# HELP bofsim_waiting_input Guest is blocked on input.\n"
+            << "# TYPE bofsim_waiting_input gauge\n"
+            << "bofsim_waiting_input " << (int)waiting_input.load(rlx) << '\n'
+            << "# HELP bofsim_steps_per_second Simulation speed over the last"
+               " update interval.\n"
+            << "# TYPE bofsim_steps_per_second gauge\n"
+            << "bofsim_steps_per_second " << steps_per_second.load(rlx) << '\n'
+            << "# HELP bofsim_resident_bytes Host resident set size.\n"
+            << "# TYPE bofsim_resident_bytes gauge\n"
+            << "bofsim_resident_bytes " << ResidentBytes() << '\n';
+        return out.str();
+    }
+    
+    static void SendAll(int fd, const std::string &data) {
+        size_t done = 0;
+        while (done < data.size()) {
+            ssize_t res = send(fd, data.data() + done, data.size() - done, 
+                               MSG_NOSIGNAL);
+            if (res < 0 && errno == EINTR)
+                continue;
+            if (res <= 0)
+                return;
+            done += res;
+        }
+    }
+    
+    /* A client may just connect and read, or speak HTTP as
+     * curl --unix-socket does; wait briefly to tell them apart */
+    void ServeClient(int fd) const {
+        char req[512];
+        ssize_t len = 0;
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 100) > 0)
+            len = recv(fd, req, sizeof(req), 0);
+        std::string body = Render();
+        if (len >= 4 && !memcmp(req, "GET ", 4)) {
+            std::ostringstream hdr;
+            hdr << "HTTP/1.0 200 OK\r\n"
+                << "Content-Type: text/plain; version=0.0.4\r\n"
+                << "Content-Length: " << body.size() << "\r\n\r\n";
+            SendAll(fd, hdr.str());
+        }
+        SendAll(fd, body);
+    }
+    
+    void WriteFile() const {
+        /* Readers never see a partially written file */
+        std::string tmp = path + ".tmp";
+        {
+            std::ofstream out(tmp, std::ios::out | std::ios::trunc);
+            out << Render();
+            if (!out)
+                return;
+        }
+        rename(tmp.c_str(), path.c_str());
+    }
+    
+    void Serve() {
+        const int tick_ms = 100; // how fast to notice shutdown
+        auto next_write = std::chrono::steady_clock::now();
+        while (!stopping.load()) {
+            if (kind == Sink::File) {
+                auto now = std::chrono::steady_clock::now();
+                if (now >= next_write) {
+                    WriteFile();
+                    next_write = now + std::chrono::milliseconds(period_ms);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(
+                                                std::min<unsigned>(tick_ms, period_ms)));
+                continue;
+            }
+            struct pollfd pfd = { listen_fd, POLLIN, 0 };
+            if (poll(&pfd, 1, tick_ms) <= 0)
+                continue;
+            int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd < 0)
+                continue;
+            ServeClient(fd);
+            close(fd);
+        }
+        if (kind == Sink::File)
+            WriteFile(); // final values
+    }
+    
+public:
+    MetricsExporter(const std::string _name, Sink _kind, 
+                    const std::string _path, unsigned _period_ms = 1000): 
+        SimObject(_name),
+        steps(0), cycles(0), pc(0), mode(0), violations(0),
+        supervisor_entries(0), bytes_in(0), bytes_out(0),
+        waiting_input(false), steps_per_second(0), stopping(false),
+        kind(_kind), path(_path), period_ms(_period_ms ? _period_ms : 1), 
+        listen_fd(-1), 
+        last_time(std::chrono::steady_clock::now()), last_steps(0),
+        server()
+    {
+        if (kind == Sink::Socket) {
+            struct sockaddr_un addr = {};
+            addr.sun_family = AF_UNIX;
+            if (path.size() >= sizeof(addr.sun_path))
+                error("Metrics socket path is too long: " + path);
+            strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+            listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (listen_fd < 0)
+                error("Cannot create metrics socket");
+            struct stat st;
+            if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+                unlink(path.c_str()); // stale socket of a previous run
+            if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 
+                || listen(listen_fd, 8) < 0) {
+                close(listen_fd);
+                error("Cannot listen on metrics socket " + path);
+            }
+        }
+        /* Profiling signals are for the simulation thread, the new 
+         * thread inherits the mask */
+        sigset_t prof, old;
+        sigemptyset(&prof);
+        sigaddset(&prof, SIGPROF);
+        pthread_sigmask(SIG_BLOCK, &prof, &old);
+        server = std::thread(&MetricsExporter::Serve, this);
+        pthread_sigmask(SIG_SETMASK, &old, nullptr);
+    }
+    
+    virtual ~MetricsExporter() {
+        stopping.store(true);
+        if (server.joinable())
+            server.join();
+        if (listen_fd >= 0) {
+            close(listen_fd);
+            unlink(path.c_str());
+        }
+    }
+    
+    /* Called from the simulation thread */
+    void Publish(const BfCpu &cpu, const IODev &io) {
+        const std::memory_order rls = std::memory_order_relaxed;
+        auto now = std::chrono::steady_clock::now();
+        uint64_t s = cpu.StepsDone();
+        double dt = std::chrono::duration<double>(now - last_time).count();
+        if (dt > 0)
+            steps_per_second.store((s - last_steps) / dt, rls);
+        last_time = now;
+        last_steps = s;
+        steps.store(s, rls);
+        cycles.store(cpu.CyclesDone(), rls);
+        pc.store((uint64_t)cpu.GetRegs().Get("pc"), rls);
+        mode.store(cpu.GetMode(), rls);
+        violations.store(cpu.Violations(), rls);
+        supervisor_entries.store(cpu.SupervisorEntries(), rls);
+        bytes_in.store(io.BytesIn(), rls);
+        bytes_out.store(io.BytesOut(), rls);
+        waiting_input.store(cpu.IsWaitingForInput(), rls);
+    }
+};
+
+#endif // METRICS_H_
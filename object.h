@@ -38,7 +38,7 @@ private:
 public:
     SimObject() = delete;
     SimObject(const std::string _name): name(_name) {
-        info(4, std::string("Creating object ") + name );
+        LOG_INFO(4, "Creating object " << name);
     };
     
     virtual ~SimObject() {}; // this makes this class virtual
@@ -47,6 +47,12 @@ public:
     
 };
 
+/* Host memory held by a component, for footprint accounting */
+class FootprintIface {
+public:
+    virtual size_t HostBytes() const = 0;
+};
+
 class RegisterAccessIface {
 
 public:
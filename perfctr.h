@@ -0,0 +1,198 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef PERFCTR_H_
+#define PERFCTR_H_
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <iomanip>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "inttypes.h"
+#include "object.h"
+#include "bofsim.h"
+#include "log.h"
+
+/* Host hardware events counted around BfCpu::Execute() with 
+ * perf_event_open(), attributed to the processor mode and the engine
+ * that did the steps. Events the host does not permit are left out;
+ * if none is permitted, the counters are simply not available. */
+class HostPerfCounters: public SimObject {
+    struct event_t {
+        const char *name;
+        uint32_t type;
+        uint64_t config;
+        int fd;
+    };
+    std::vector<event_t> events;
+    std::vector<event_t*> opened; // in group read order
+    int leader;
+    
+    struct totals_t {
+        step_t steps;
+        std::vector<double> values; // per opened event
+    };
+    std::string engine;
+    totals_t totals[2]; // by mode that executes code
+    std::vector<uint64_t> before;
+    uint64_t before_enabled, before_running;
+    
+    static int Open(uint32_t type, uint64_t config, int group_fd) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = group_fd < 0; // leader starts the whole group
+        attr.exclude_kernel = 1; // also allowed with stricter paranoia
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | 
+                           PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+    }
+    
+    /* RETURN: false if counters cannot be read */
+    bool ReadGroup(std::vector<uint64_t> &values, uint64_t &enabled, 
+                   uint64_t &running) {
+        std::vector<uint64_t> buf(3 + opened.size());
+        ssize_t len = read(leader, buf.data(), buf.size() * sizeof(uint64_t));
+        if (len != (ssize_t)(buf.size() * sizeof(uint64_t)))
+            return false;
+        enabled = buf[1];
+        running = buf[2];
+        values.assign(buf.begin() + 3, buf.end());
+        return true;
+    }
+
+public:
+    HostPerfCounters(const std::string _name, 
+                     const std::string &_engine = "interp"):
+        SimObject(_name), events(), opened(), leader(-1), engine(_engine),
+        before(), before_enabled(0), before_running(0)
+    {
+        uint64_t dtlb = PERF_COUNT_HW_CACHE_DTLB | 
+                        (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        events = {
+            {"task-clock-ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, -1},
+            {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1},
+            {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1},
+            {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, -1},
+            {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, -1},
+            {"dTLB-misses", PERF_TYPE_HW_CACHE, dtlb, -1},
+        };
+        for (auto &e: events) {
+            e.fd = Open(e.type, e.config, leader);
+            if (e.fd < 0) {
+                info(1, std::string("Host event ") + e.name + 
+                        " is not available: " + strerror(errno));
+                continue;
+            }
+            if (leader < 0)
+                leader = e.fd;
+            opened.push_back(&e);
+        }
+        for (auto &t: totals) {
+            t.steps = 0;
+            t.values.assign(opened.size(), 0.0);
+        }
+        if (leader >= 0)
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    
+    virtual ~HostPerfCounters() {
+        for (auto &e: events)
+            if (e.fd >= 0)
+                close(e.fd);
+    }
+    
+    bool Available() const { return leader >= 0; }
+    
+    /* Call right before and right after Execute(), with the mode the 
+     * CPU was in before it and the number of steps it did. Execute() 
+     * must not cross mode changes for the attribution to be exact. */
+    void Begin() {
+        if (leader >= 0)
+            ReadGroup(before, before_enabled, before_running);
+    }
+    
+    void End(processor_mode_t mode, step_t steps) {
+        if (leader < 0 || mode > SupervisorMode)
+            return;
+        std::vector<uint64_t> after;
+        uint64_t enabled, running;
+        if (!ReadGroup(after, enabled, running) || 
+            before.size() != after.size())
+            return;
+        /* Scale up if events were multiplexed with others */
+        double scale = running > before_running ? 
+                       (double)(enabled - before_enabled) / 
+                       (running - before_running) : 1.0;
+        totals[mode].steps += steps;
+        for (size_t i = 0; i < after.size(); i++)
+            totals[mode].values[i] += (after[i] - before[i]) * scale;
+    }
+    
+    void Report(std::ostream &out) const {
+        if (leader < 0) {
+            out << "Host performance counters are not available\n";
+            return;
+        }
+        const std::ios::fmtflags flags = out.flags();
+        const std::streamsize precision = out.precision();
+        out << "Host events per simulated step:\n"
+            << "engine  mode        steps";
+        for (auto e: opened)
+            out << std::setw(15) << e->name;
+        out << '\n';
+        for (int mode = ApplicationMode; mode <= SupervisorMode; mode++) {
+            const totals_t &t = totals[mode];
+            if (!t.steps)
+                continue;
+            out << std::left << std::setw(8) << engine 
+                << std::setw(4) << (mode ? "sup" : "app") << std::right
+                << std::setw(13) << t.steps;
+            for (double v: t.values)
+                out << std::setw(15) << std::fixed << std::setprecision(3) 
+                    << v / t.steps;
+            out << '\n';
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+};
+
+#endif // PERFCTR_H_
@@ -0,0 +1,104 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef POLLER_H_
+#define POLLER_H_
+
+#include <vector>
+#include <unordered_map>
+
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include "object.h"
+#include "bofsim.h"
+
+/* Lets a host run many guests on few threads. A processor whose 
+ * ExecuteOneStep()/Execute() reported waiting for input is parked here 
+ * together with the descriptor its IO device reads from, and is handed 
+ * back once that descriptor becomes readable.
+ */
+class InputPoller: public SimObject {
+    int epfd;
+    std::unordered_map<int, BfCpu*> parked; // descriptor -> waiting CPU
+    std::vector<BfCpu*> ready; // CPUs runnable without waiting
+    std::vector<struct epoll_event> events;
+    
+public:
+    InputPoller(const std::string _name, size_t batch = 64): 
+        SimObject(_name),
+        epfd(epoll_create1(EPOLL_CLOEXEC)),
+        parked(),
+        ready(),
+        events(batch)
+    {
+        if (epfd < 0)
+            error("Cannot create epoll instance");
+    }
+    
+    virtual ~InputPoller() {
+        if (epfd >= 0) close(epfd);
+    }
+    
+    /* Park cpu until fd has data. One-shot: the descriptor is disarmed
+     * when the CPU is handed back by Wait() */
+    void Park(int fd, BfCpu &cpu) {
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN | EPOLLONESHOT;
+        ev.data.fd = fd;
+        int op = parked.count(fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+        if (epoll_ctl(epfd, op, fd, &ev) < 0) {
+            // Regular files cannot be polled and are always readable
+            ready.push_back(&cpu);
+            return;
+        }
+        parked[fd] = &cpu;
+    }
+    
+    size_t Parked() const { return parked.size() + ready.size(); }
+    
+    /* Wait for up to timeout_ms (-1 is forever) for any parked CPU 
+     * to become runnable. RETURN: CPUs to resume */
+    std::vector<BfCpu*> Wait(int timeout_ms) {
+        std::vector<BfCpu*> result;
+        result.swap(ready);
+        if (!result.empty())
+            timeout_ms = 0;
+        int n = epoll_wait(epfd, events.data(), events.size(), timeout_ms);
+        for (int i = 0; i < n; i++) {
+            auto it = parked.find(events[i].data.fd);
+            if (it == parked.end())
+                continue;
+            result.push_back(it->second);
+            parked.erase(it);
+            epoll_ctl(epfd, EPOLL_CTL_DEL, events[i].data.fd, nullptr);
+        }
+        return result;
+    }
+};
+
+#endif // POLLER_H_
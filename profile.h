@@ -0,0 +1,206 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <iomanip>
+#include <algorithm>
+
+#include "inttypes.h"
+#include "object.h"
+#include "memory.h"
+#include "bofsim.h"
+#include "log.h"
+
+/* Counts executed steps and cycles for every PC of both instruction
+ * memories, and reports the hottest instructions, loops and source lines.
+ * The processor updates the counters directly once Attach()'ed. */
+class PcProfiler: public SimObject, public FootprintIface {
+    typedef pc_counter_t counter_t;
+    /* Flat arrays indexed by PC, one per mode that executes code */
+    std::vector<counter_t> counters[2];
+    
+    struct hot_range_t {
+        int mode;
+        address_t start, end; // instructions [start, end]
+        step_t steps;
+        cycle_t cycles;
+    };
+    
+    static const char* ModeName(int mode) {
+        return mode == ApplicationMode ? "app" : "sup";
+    }
+    
+    static double Share(step_t part, step_t total) {
+        return total ? 100.0 * part / total : 0.0;
+    }
+    
+    static std::string Printable(char c) {
+        if (c >= 0x20 && c < 0x7f)
+            return std::string(1, c);
+        char buf[8];
+        snprintf(buf, sizeof(buf), "\\x%02x", (uint8_t)c);
+        return buf;
+    }
+    
+    /* Loops of code in mode, found by matching brackets */
+    std::vector<hot_range_t> Loops(int mode, const MemoryIface &code) const {
+        std::vector<hot_range_t> loops;
+        std::vector<address_t> open;
+        const char *text = code.Dump();
+        size_t len = std::min(code.Size(), counters[mode].size());
+        for (address_t pc = 0; pc < len && text[pc]; pc++) {
+            if (text[pc] == '[') {
+                open.push_back(pc);
+            } else if (text[pc] == ']' && !open.empty()) {
+                hot_range_t loop = {mode, open.back(), pc, 0, 0};
+                open.pop_back();
+                for (address_t i = loop.start; i <= loop.end; i++) {
+                    loop.steps += counters[mode][i].steps;
+                    loop.cycles += counters[mode][i].cycles;
+                }
+                loops.push_back(loop);
+            }
+        }
+        return loops;
+    }
+    
+    void ReportListing(std::ostream &out, int mode, const MemoryIface &code,
+                       step_t total) const {
+        const char *text = code.Dump();
+        size_t len = std::min(code.Size(), counters[mode].size());
+        address_t line_start = 0;
+        step_t line_steps = 0;
+        int line_no = 1;
+        for (address_t pc = 0; pc <= len; pc++) {
+            bool end = pc == len || !text[pc];
+            if (!end)
+                line_steps += counters[mode][pc].steps;
+            if (end || text[pc] == '\n') {
+                if (line_steps || pc > line_start)
+                    out << std::setw(7) << std::fixed << std::setprecision(2)
+                        << Share(line_steps, total) << "% " 
+                        << std::setw(5) << line_no << ": "
+                        << std::string(text + line_start, pc - line_start)
+                        << '\n';
+                line_start = pc + 1;
+                line_steps = 0;
+                line_no++;
+            }
+            if (end)
+                break;
+        }
+    }
+
+public:
+    PcProfiler(const std::string _name, address_t il): SimObject(_name) {
+        counters[ApplicationMode].resize(il + 1);
+        counters[SupervisorMode].resize(il + 1);
+    }
+    
+    virtual size_t HostBytes() const {
+        return (counters[0].capacity() + counters[1].capacity()) * 
+               sizeof(counter_t);
+    }
+    
+    void Attach(BfCpu &cpu) { cpu.SetPcCounters(counters); }
+    void Detach(BfCpu &cpu) { cpu.SetPcCounters(nullptr); }
+    
+    step_t Steps(int mode, address_t pc) const {
+        return pc < counters[mode].size() ? counters[mode][pc].steps : 0;
+    }
+    
+    void Report(std::ostream &out, const MemoryIface &acode, 
+                const MemoryIface &scode, size_t top = 20) const {
+        const MemoryIface *code[2] = {&acode, &scode};
+        step_t total = 0;
+        cycle_t total_cycles = 0;
+        step_t mode_steps[2] = {0, 0};
+        std::vector<hot_range_t> insns, loops;
+        for (int mode = ApplicationMode; mode <= SupervisorMode; mode++) {
+            for (address_t pc = 0; pc < counters[mode].size(); pc++) {
+                const counter_t &c = counters[mode][pc];
+                if (!c.steps)
+                    continue;
+                mode_steps[mode] += c.steps;
+                total_cycles += c.cycles;
+                insns.push_back({mode, pc, pc, c.steps, c.cycles});
+            }
+            std::vector<hot_range_t> l = Loops(mode, *code[mode]);
+            loops.insert(loops.end(), l.begin(), l.end());
+            total += mode_steps[mode];
+        }
+        auto hotter = [](const hot_range_t &a, const hot_range_t &b) {
+            return a.steps > b.steps;
+        };
+        std::sort(insns.begin(), insns.end(), hotter);
+        std::sort(loops.begin(), loops.end(), hotter);
+        
+        const std::ios::fmtflags flags = out.flags();
+        const std::streamsize precision = out.precision();
+        out << "Profile: " << total << " steps, " << total_cycles 
+            << " cycles, application " << mode_steps[ApplicationMode] 
+            << ", supervisor " << mode_steps[SupervisorMode] << "\n"
+            << "\nHottest instructions:\n"
+            << "   share  mode     pc  op       steps      cycles\n";
+        for (size_t i = 0; i < insns.size() && i < top; i++) {
+            const hot_range_t &h = insns[i];
+            char op = code[h.mode]->Size() > h.start ? 
+                      code[h.mode]->Dump()[h.start] : '\0';
+            out << std::setw(7) << std::fixed << std::setprecision(2) 
+                << Share(h.steps, total) << "%  " << ModeName(h.mode) 
+                << std::setw(7) << h.start << "  " << std::setw(4) 
+                << Printable(op) << std::setw(12) << h.steps
+                << std::setw(12) << h.cycles << '\n';
+        }
+        out << "\nHottest loops (inclusive of nested ones):\n"
+            << "   share  mode  start    end       steps      cycles\n";
+        for (size_t i = 0; i < loops.size() && i < top && loops[i].steps; i++) {
+            const hot_range_t &h = loops[i];
+            out << std::setw(7) << std::fixed << std::setprecision(2) 
+                << Share(h.steps, total) << "%  " << ModeName(h.mode) 
+                << std::setw(7) << h.start << std::setw(7) << h.end
+                << std::setw(12) << h.steps << std::setw(12) << h.cycles 
+                << '\n';
+        }
+        for (int mode = ApplicationMode; mode <= SupervisorMode; mode++) {
+            if (!mode_steps[mode])
+                continue;
+            out << "\nAnnotated " << ModeName(mode) << " code, step share"
+                   " per source line:\n";
+            ReportListing(out, mode, *code[mode], total);
+        }
+        out.flags(flags);
+        out.precision(precision);
+    }
+};
+
+#endif // PROFILE_H_
@@ -0,0 +1,215 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef PROGEN_H_
+#define PROGEN_H_
+
+#include <string>
+#include <random>
+#include <algorithm>
+
+#include "inttypes.h"
+#include "object.h"
+#include "config.h"
+
+/* Everything needed to run a program from reset */
+struct random_program_t {
+    Configuration cfg;
+    std::string acode;
+    std::string scode;
+    std::string tape;  // initial contents
+    std::string input; // bytes available to ','
+};
+
+/* Generates random but well-formed programs for differential testing.
+ * Loops are balanced and nest no deeper than asked, but programs still 
+ * trap to the supervisor, run out of stack, wrap cells, block on input
+ * and may loop forever, so run them with a step budget.
+ * The same seed gives the same programs on every host. */
+class ProgramGenerator: public SimObject {
+    std::mt19937_64 rng;
+    size_t max_len;
+    unsigned max_depth;
+    
+    /* Uniform enough for testing, and unlike std distributions 
+     * identical across standard libraries */
+    unsigned Below(unsigned n) { return n ? rng() % n : 0; }
+    
+    std::string Block(size_t len, unsigned depth, bool in_supervisor) {
+        /* '>' outweighs '<' so that the tape gets used, not only its start */
+        static const char ops[] = "++--->>><<..,";
+        std::string s;
+        while (s.size() < len) {
+            unsigned r = Below(100);
+            if (r < 12 && depth < max_depth && len - s.size() > 4) {
+                size_t inner = 1 + Below((len - s.size()) / 2);
+                s += '[' + Block(inner, depth + 1, in_supervisor) + ']';
+            } else if (r < 14) {
+                s += "[-]"; // an idiom fast paths like to recognize
+            } else if (r < 15 && in_supervisor) {
+                s += ']';   // return to application, or halt if nested
+            } else if (r < 16) {
+                s += ' ';   // comments are NOPs
+            } else {
+                s += ops[Below(sizeof(ops) - 1)];
+            }
+        }
+        return s;
+    }
+    
+public:
+    ProgramGenerator(const std::string _name, uint64_t seed, 
+                     size_t _max_len = 256, unsigned _max_depth = 8):
+        SimObject(_name), rng(seed), max_len(_max_len), 
+        max_depth(_max_depth) {};
+    
+    random_program_t Next() {
+        random_program_t p;
+        p.cfg.cfg = { {"tl", 10},
+                      {"tw", 8},
+                      {"nm", 3},
+                      {"sd", 1 + Below(max_depth + 2)}, // overflows too
+                      {"il", 4096}
+        };
+        p.acode = Block(1 + Below(max_len), 0, false);
+        if (Below(2))
+            p.scode = Block(1 + Below(max_len / 4), 0, true) + ']';
+        size_t tape_len = Below(16);
+        for (size_t i = 0; i < tape_len; i++)
+            p.tape += (char)Below(4);
+        size_t input_len = Below(32);
+        for (size_t i = 0; i < input_len; i++)
+            p.input += (char)Below(256);
+        return p;
+    }
+};
+
+/* Knobs of a synthetic workload. Ratios are in [0, 1]. */
+struct workload_params_t {
+    unsigned depth = 1;       // loop nesting, at most SD - 1
+    double footprint = 0;     // share of the tape swept every iteration
+    double skipped = 0;       // share of operations in never-taken blocks
+    double comments = 0;      // share of NOP bytes in the code
+    double io = 0;            // share of operations that are '.'
+    double violations = 0;    // share of operations that trap to supervisor
+    size_t ops = 256;         // operations in the innermost loop body
+};
+
+/* Generates endless programs with the given properties, to measure how 
+ * simulation speed scales with each of them; run them for a number of
+ * steps. Tape layout: 
+ *   0                    - application traps by moving left from here
+ *   1                    - work cell for arithmetic and output
+ *   2                    - always zero, guards skipped blocks
+ *   3 .. 3+depth-1       - loop counters, the outermost one never ends
+ *   3+depth              - zero marker
+ *   3+depth+1 ..         - swept region of non-zero cells
+ *   after it             - zero marker
+ * The supervisor moves TP right and returns, so the trapping '<' is 
+ * retried and succeeds. */
+class WorkloadGenerator: public SimObject {
+    std::mt19937_64 rng;
+    
+    bool Chance(double p) { 
+        return (rng() >> 11) * (1.0 / 9007199254740992.0) < p; 
+    }
+    
+public:
+    WorkloadGenerator(const std::string _name, uint64_t seed = 1):
+        SimObject(_name), rng(seed) {};
+    
+    random_program_t Generate(const workload_params_t &w, 
+                              unsigned tl = 10, unsigned sd = 16) {
+        random_program_t p;
+        p.cfg.cfg = { {"tl", tl},
+                      {"tw", 8},
+                      {"nm", 3},
+                      {"sd", sd},
+                      {"il", 4096}
+        };
+        unsigned depth = std::max(1u, std::min(w.depth, sd - 1));
+        const address_t counters = 3;
+        const address_t region = counters + depth + 1;
+        address_t tape_len = tl == 9999 ? 9999 : (address_t)1 << tl;
+        address_t swept = (address_t)(w.footprint * tape_len);
+        swept = std::min(swept, tape_len - region - 2);
+        p.tape.assign(region, '\0');
+        p.tape.append(swept, '\1');
+        p.scode = ">]";
+        
+        /* Innermost body, executed with TP at the work cell */
+        std::string body, skip_block;
+        for (size_t i = 0; i < w.ops; i++) {
+            std::string op = Chance(w.violations) ? "<<>" : 
+                             Chance(w.io) ? "." : 
+                             i % 2 ? "+" : "-";
+            if (Chance(w.skipped)) {
+                skip_block += op;
+                continue;
+            }
+            if (skip_block.size())
+                body += ">[" + skip_block + "]<";
+            skip_block.clear();
+            body += op;
+        }
+        if (skip_block.size())
+            body += ">[" + skip_block + "]<";
+        
+        std::string code(counters, '>');
+        address_t inner = counters + depth - 1;
+        for (unsigned d = 0; d < depth; d++) {
+            code += d ? std::string(4, '+') : "+"; // the outermost is endless
+            code += '[';
+            if (d + 1 < depth)
+                code += '>';
+        }
+        code += std::string(inner - 1, '<') + body + 
+                std::string(inner - 1, '>');
+        if (swept)
+            code += std::string(region - inner, '>') + "[>]<[<]" + 
+                    std::string(region - 1 - inner, '<');
+        for (unsigned d = depth; d > 0; d--) {
+            code += d > 1 ? "-]<" : "]";
+        }
+        
+        /* Spread NOPs evenly */
+        if (w.comments > 0 && w.comments < 1) {
+            std::string commented;
+            double nops = 0;
+            for (char c: code) {
+                commented += c;
+                for (nops += w.comments / (1 - w.comments); nops >= 1; nops--)
+                    commented += ' ';
+            }
+            code.swap(commented);
+        }
+        p.acode = code;
+        return p;
+    }
+};
+
+#endif // PROGEN_H_
@@ -0,0 +1,163 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <string>
+#include <ostream>
+#include <iomanip>
+#include <chrono>
+#include <cstring>
+
+#include "inttypes.h"
+#include "object.h"
+#include "bofsim.h"
+#include "log.h"
+
+/* Run statistics: instruction mix, execution results, mode residency and
+ * simulation speed */
+class RunStats: public SimObject, public ExecutionObserverIface {
+    static const int result_kinds = (int)ExecuteResult::WouldBlock + 1;
+    
+    uint64_t opcodes[256];
+    uint64_t results[result_kinds];
+    step_t mode_steps[2];
+    step_t skipping_steps; // executed with SK > 0
+    step_t steps;
+    cycle_t cycles;
+    std::chrono::steady_clock::time_point start;
+    
+    static const char* ResultName(int res) {
+        static const char *names[result_kinds] = {
+            "regular", "controlflow", "violation", "skipping", 
+            "nop", "halt", "wouldblock"
+        };
+        return names[res];
+    }
+    
+    /* Opcodes that are instructions, all the rest are NOPs */
+    static bool IsInstruction(int opc) {
+        return opc == 0 || strchr("<>+-.,[]", opc);
+    }
+    
+public:
+    RunStats(const std::string _name): 
+        SimObject(_name), skipping_steps(0), steps(0), cycles(0), 
+        start(std::chrono::steady_clock::now())
+    {
+        memset(opcodes, 0, sizeof(opcodes));
+        memset(results, 0, sizeof(results));
+        mode_steps[0] = mode_steps[1] = 0;
+    }
+    
+    virtual void OnStep(const step_record_t &rec) {
+        opcodes[rec.opcode]++;
+        results[rec.result]++;
+        if (rec.mode <= SupervisorMode)
+            mode_steps[rec.mode]++;
+        skipping_steps += rec.skipping;
+        steps++;
+        cycles += rec.cycles;
+    }
+    
+    /* Speed from the processor's own counters, for runs without
+     * observers. IN: simulation time in microseconds */
+    static void ReportSpeed(std::ostream &out, const BfCpu &cpu, double us) {
+        double wall = us / 1e6;
+        out << "{\"steps\": " << cpu.StepsDone() 
+            << ", \"cycles\": " << cpu.CyclesDone()
+            << ", \"wall_seconds\": " << wall 
+            << ", \"steps_per_second\": " 
+            << (wall > 0 ? cpu.StepsDone() / wall : 0)
+            << ", \"cycles_per_second\": " 
+            << (wall > 0 ? cpu.CyclesDone() / wall : 0) << "}\n";
+    }
+    
+    void Report(std::ostream &out, const BfCpu &cpu, bool json = false) const {
+        double wall = std::chrono::duration<double>(
+                        std::chrono::steady_clock::now() - start).count();
+        double sps = wall > 0 ? steps / wall : 0;
+        double cps = wall > 0 ? cycles / wall : 0;
+        uint64_t nops = 0;
+        for (int opc = 0; opc < 256; opc++)
+            if (!IsInstruction(opc))
+                nops += opcodes[opc];
+        if (json) {
+            out << "{\"steps\": " << steps << ", \"cycles\": " << cycles
+                << ", \"wall_seconds\": " << wall 
+                << ", \"steps_per_second\": " << sps
+                << ", \"cycles_per_second\": " << cps
+                << ", \"app_steps\": " << mode_steps[ApplicationMode]
+                << ", \"sup_steps\": " << mode_steps[SupervisorMode]
+                << ", \"supervisor_entries\": " << cpu.SupervisorEntries()
+                << ", \"violations\": " << cpu.Violations()
+                << ", \"skipping_steps\": " << skipping_steps
+                << ", \"opcodes\": {";
+            const char *sep = "";
+            for (const char *op = "<>+-.,[]"; *op; op++) {
+                out << sep << "\"" << *op << "\": " << opcodes[(uint8_t)*op];
+                sep = ", ";
+            }
+            out << ", \"end\": " << opcodes[0] << ", \"nop\": " << nops
+                << "}, \"results\": {";
+            for (int res = 0; res < result_kinds; res++)
+                out << (res ? ", " : "") << "\"" << ResultName(res) << "\": " 
+                    << results[res];
+            out << "}}\n";
+            return;
+        }
+        const std::ios::fmtflags flags = out.flags();
+        const std::streamsize precision = out.precision();
+        out << "Run statistics:\n"
+            << "  steps              " << steps << '\n'
+            << "  cycles             " << cycles << '\n'
+            << "  wall time, s       " << wall << '\n'
+            << "  steps per second   " << std::fixed << std::setprecision(0) 
+            << sps << '\n'
+            << "  cycles per second  " << cps << '\n'
+            << "  application steps  " << mode_steps[ApplicationMode] << '\n'
+            << "  supervisor steps   " << mode_steps[SupervisorMode] << '\n'
+            << "  supervisor entries " << cpu.SupervisorEntries() << '\n'
+            << "  violations         " << cpu.Violations() << '\n'
+            << "  skipping steps     " << skipping_steps << '\n'
+            << "Instruction mix:\n";
+        for (const char *op = "<>+-.,[]"; *op; op++)
+            out << "  " << *op << "  " << std::setw(16) 
+                << opcodes[(uint8_t)*op] << '\n';
+        out << "  \\0 " << std::setw(16) << opcodes[0] << '\n'
+            << "  nop" << std::setw(16) << nops << '\n'
+            << "Execution results:\n";
+        for (int res = 0; res < result_kinds; res++)
+            out << "  " << std::left << std::setw(12) << ResultName(res) 
+                << std::right << std::setw(16) << results[res] << '\n';
+        out.flags(flags);
+        out.precision(precision);
+    }
+};
+
+#endif // STATS_H_
@@ -0,0 +1,105 @@
+// Unit test to check cycles charged by the cost model
+
+#include <string>
+#include <iostream>
+
+#include "expect.h"
+#include "memory.h"
+#include "bofsim.h"
+#include "iodev.h"
+#include "config.h"
+#include "costmodel.h"
+#include "fold.h"
+
+#define BUFSIZE 4096
+
+int main() {
+    Configuration cpuCfg;
+    cpuCfg.cfg = { {"tl", 10},
+                   {"tw", 8},
+                   {"nm", 3},
+                   {"sd", 2},
+                   {"il", BUFSIZE}
+    };
+    
+    /* Add Objects */
+    Memory tape("tape");
+    Memory acodeInstr("ainstr");
+    Memory scodeInstr("sinstr");
+    IODev  io("io");
+    BfCpu  cpu("cpu", cpuCfg, tape, acodeInstr, scodeInstr, io);
+    
+    Configuration costCfg;
+    costCfg.cfg = { {"plus", 2},
+                    {"minus", 3},
+                    {"branch", 4},
+                    {"sventry", 10}
+    };
+    CostModel cost("cost", costCfg);
+    cpu.SetCostModel(&cost);
+
+    /* One taken ']', a comment and a violation */
+    std::string acode = "++[-]x<";
+    acodeInstr.LoadRaw(acode.c_str(), acode.size() + 1);
+    
+    /* Do simulation */
+    steps_cycles_t done = cpu.Execute(10);
+    TestExpectEqual(SupervisorMode, cpu.GetMode(), "Violation is reached");
+    TestExpectEqual(10, done.first, "Steps are not affected");
+    /* ']' returns to '[' which is executed again */
+    TestExpectEqual(2 + 2 + 1 + 3 + (1 + 4) + 1 + 3 + 1 + 0 + (1 + 10), 
+                    done.second, "Cycles follow the cost model");
+    TestExpectEqual(done.second, cpu.CyclesDone(), "Cycles are accumulated");
+    
+    /* Tape latency with a single two-cell line */
+    Memory tape2("tape2");
+    BfCpu  cpu2("cpu2", cpuCfg, tape2, acodeInstr, scodeInstr, io);
+    Configuration latencyCfg;
+    latencyCfg.cfg = { {"tape_lines", 1},
+                       {"tape_line", 2},
+                       {"tape_miss", 7}
+    };
+    CostModel latency("latency", latencyCfg);
+    cpu2.SetCostModel(&latency);
+    acode = "+>+>+";
+    acodeInstr.LoadRaw(acode.c_str(), acode.size() + 1);
+    done = cpu2.Execute(acode.size());
+    TestExpectEqual(acode.size() + 7 + 7, done.second, 
+                    "Two misses, one hit");
+    
+    /* Without a model every instruction is one cycle */
+    cpu2.SetCostModel(nullptr);
+    cpu2.SetRegister("pc", 0);
+    done = cpu2.Execute(acode.size());
+    TestExpectEqual(acode.size(), done.second, "Flat cost by default");
+    
+    /* A run resumed from a folded prefix keeps the cached tape lines */
+    Configuration oneLineCfg;
+    oneLineCfg.cfg = { {"tape_lines", 1},
+                       {"tape_line", 1},
+                       {"tape_miss", 7}
+    };
+    acode = "+++++";
+    acodeInstr.LoadRaw(acode.c_str(), acode.size() + 1);
+    Memory tape3("tape3");
+    BfCpu  cpu3("cpu3", cpuCfg, tape3, acodeInstr, scodeInstr, io);
+    CostModel plain("plain", oneLineCfg);
+    cpu3.SetCostModel(&plain);
+    done = cpu3.Execute(acode.size());
+    TestExpectEqual(5 + 7, done.second, "One miss, then hits");
+    
+    Memory tape4("tape4");
+    BfCpu  cpu4("cpu4", cpuCfg, tape4, acodeInstr, scodeInstr, io);
+    CostModel resumed("resumed", oneLineCfg);
+    cpu4.SetCostModel(&resumed);
+    OutputFolder folder("folder", ".", 2, &resumed);
+    folded_prefix_t prefix = folder.Evaluate(cpuCfg, acodeInstr, 
+                                             scodeInstr, tape4);
+    OutputFolder::Apply(prefix, cpu4, tape4, io);
+    cpu4.Execute(acode.size() - prefix.steps);
+    TestExpectEqual(2, prefix.steps, "Prefix is two steps");
+    TestExpectEqual(cpu3.CyclesDone(), cpu4.CyclesDone(), 
+                    "Folding does not change cycles");
+    
+    return 0;
+}
@@ -0,0 +1,77 @@
+// Unit test to check counters mapped into supervisor tape space
+
+#include <exception>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <iostream>
+
+#include "expect.h"
+#include "memory.h"
+#include "bofsim.h"
+#include "iodev.h"
+#include "config.h"
+
+#define BUFSIZE 4096
+
+/* Output device remembering what was written */
+class MockIO: public SimObject, public IOIface {
+public:
+    std::vector<my_uint128_t> out;
+    MockIO(const std::string _name): SimObject(_name) {};
+    virtual my_uint128_t Read() { return 0; }
+    virtual void Write(my_uint128_t val) { out.push_back(val); }
+};
+
+int main() {
+    Configuration cpuCfg;
+    cpuCfg.cfg = { {"tl", 10},
+                   {"tw", 8},
+                   {"nm", 3},
+                   {"sd", 1},
+                   {"il", BUFSIZE}
+    };
+    
+    /* Add Objects */
+    Memory tape("tape");
+    Memory acodeInstr("ainstr");
+    Memory scodeInstr("sinstr");
+    MockIO io("io");
+    BfCpu  cpu("cpu", cpuCfg, tape, acodeInstr, scodeInstr, io);
+
+    /* Application violates at the end of tape */
+    std::string acode = ">";
+    acodeInstr.LoadRaw(acode.c_str(), acode.size() + 1);
+    cpu.SetRegister("tp", 1023);
+    
+    /* Supervisor outputs entries, cycles and steps, then tries to 
+     * increment the step counter */
+    std::string scode = std::string(1023 - 1006, '<') + ".<.<.+.";
+    scodeInstr.LoadRaw(scode.c_str(), scode.size() + 1);
+    
+    /* Do simulation */
+    cpu.Execute(1 + scode.size());
+    TestExpectEqual(SupervisorMode, cpu.GetMode(), "Supervisor is running");
+    TestExpectEqual(4, io.out.size(), "Four values are output");
+    TestExpectEqual(1, io.out[0], "Supervisor entries are mapped at 1006");
+    TestExpectEqual(1 + 1023 - 1006 + 2, io.out[1], 
+                    "Cycles are mapped at 1005");
+    TestExpectEqual(1 + 1023 - 1006 + 4, io.out[2], 
+                    "Steps are mapped at 1004");
+    TestExpectEqual(1 + 1023 - 1006 + 6, io.out[3], 
+                    "Step counter is not writable");
+    TestExpectEqual(0, tape.Read(1004), "Tape at 1004 is not touched");
+    
+    /* Counters are a part of the checkpoint */
+    std::stringstream state;
+    cpu.SaveState(state);
+    Memory tape2("tape2");
+    BfCpu  cpu2("cpu2", cpuCfg, tape2, acodeInstr, scodeInstr, io);
+    cpu2.RestoreState(state);
+    TestExpectEqual(cpu.StepsDone(), cpu2.StepsDone(), "Steps are restored");
+    TestExpectEqual(cpu.CyclesDone(), cpu2.CyclesDone(), 
+                    "Cycles are restored");
+    TestExpectEqual(1, cpu2.SupervisorEntries(), "Entries are restored");
+    
+    return 0;
+}
@@ -0,0 +1,46 @@
+// Unit test to check that the differential harness finds no divergence in
+// the engines and finds the first divergent step of a broken one
+
+#include <exception>
+#include <string>
+#include <iostream>
+
+#include "expect.h"
+#include "diffexec.h"
+#include "progen.h"
+
+/* Batch engine which corrupts the tape once at step 1234 */
+class BrokenEngine: public EngineIface {
+public:
+    virtual std::string Name() const { return "broken"; }
+    virtual step_t Run(DiffMachine &m, step_t steps) {
+        step_t done = m.cpu.Execute(steps).first;
+        if (m.steps < 1234 && m.steps + done >= 1234)
+            m.tape.Write(50, 1);
+        return done;
+    }
+};
+
+int main() {
+    ProgramGenerator gen("progen", 42);
+    DifferentialHarness harness("harness", 20000, 1000);
+    BatchEngine batch;
+    FoldEngine fold;
+    for (int i = 0; i < 100; i++) {
+        random_program_t p = gen.Next();
+        TestExpectEqual(false, harness.Run(p, batch).found, 
+                        "Batch engine matches the reference");
+        TestExpectEqual(false, harness.Run(p, fold).found, 
+                        "Fold engine matches the reference");
+    }
+    
+    random_program_t endless;
+    endless.cfg.cfg = { {"tl", 10}, {"tw", 8}, {"nm", 3}, {"sd", 4}, 
+                        {"il", 4096} };
+    endless.acode = "+[>+<]";
+    BrokenEngine broken;
+    divergence_t d = harness.Run(endless, broken);
+    TestExpectEqual(true, d.found, "Corruption is found");
+    TestExpectEqual(1234, d.step, "First divergent step is found");
+    return 0;
+}
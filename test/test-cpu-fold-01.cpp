@@ -0,0 +1,62 @@
+// Unit test to check that a folded prefix resumes to the same state
+
+#include <exception>
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include "expect.h"
+#include "memory.h"
+#include "bofsim.h"
+#include "fold.h"
+#include "config.h"
+
+int main() {
+    Configuration cpuCfg;
+    cpuCfg.cfg = { {"tl", 10},
+                   {"tw", 8},
+                   {"nm", 3},
+                   {"sd", 4},
+                   {"il", 4096}
+    };
+    /* Output is done before the first input and after it */
+    std::string acode("++++++[>++++++++<-]>.+.<,>.");
+    
+    Memory tape("tape");
+    Memory acodeInstr("ainstr");
+    Memory scodeInstr("sinstr");
+    RecordingIO io("io");
+    BfCpu  cpu("cpu", cpuCfg, tape, acodeInstr, scodeInstr, io);
+    acodeInstr.LoadRaw(acode.c_str(), acode.size() + 1);
+    
+    /* Folded prefix stops at the input, evaluated from reset */
+    OutputFolder folder("folder", ".", 1000);
+    folded_prefix_t prefix = folder.Evaluate(cpuCfg, acodeInstr, 
+                                             scodeInstr, tape);
+    TestExpectTrue(prefix.output == "01", "Prefix output is recorded");
+    
+    /* Reference: run everything at once */
+    steps_cycles_t ref = cpu.Execute(1000);
+    std::ostringstream ref_state;
+    cpu.SaveState(ref_state);
+    TestExpectEqual(ref.first, prefix.steps, "Prefix stops at the input");
+    
+    /* Resume another system from the prefix */
+    Memory tape2("tape2");
+    RecordingIO io2("io2");
+    BfCpu  cpu2("cpu2", cpuCfg, tape2, acodeInstr, scodeInstr, io2);
+    OutputFolder::Apply(prefix, cpu2, tape2, io2);
+    std::ostringstream state2;
+    cpu2.SaveState(state2);
+    TestExpectTrue(ref_state.str() == state2.str(), "State is restored");
+    TestExpectTrue(io2.out == io.out, "Output is replayed");
+    TestExpectEqual(tape.Read(1), tape2.Read(1), "Tape is restored");
+    
+    /* A different configuration must give a different key */
+    uint64_t key = folder.Key(cpuCfg, acodeInstr, scodeInstr, tape);
+    cpuCfg.Set("tw", 16);
+    TestExpectTrue(key != folder.Key(cpuCfg, acodeInstr, scodeInstr, tape),
+                   "Configuration is a part of the key");
+    
+    return 0;
+}
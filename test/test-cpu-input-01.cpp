@@ -0,0 +1,67 @@
+// Unit test to check ',' instruction waiting for input
+
+#include <exception>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <istream>
+
+#include "expect.h"
+#include "memory.h"
+#include "bofsim.h"
+#include "iodev.h"
+#include "config.h"
+
+#define BUFSIZE 4096
+
+/* Input device that has no data until told otherwise */
+class MockIO: public SimObject, public IOIface {
+public:
+    bool has_data = false;
+    MockIO(const std::string _name): SimObject(_name) {};
+    virtual my_uint128_t Read() { return 'x'; }
+    virtual void Write(my_uint128_t val) {}
+    virtual bool TryRead(my_uint128_t &val) {
+        if (!has_data)
+            return false;
+        val = Read();
+        return true;
+    }
+};
+
+int main() {
+    Configuration cpuCfg;
+    cpuCfg.cfg = { {"tl", 10},
+                   {"tw", 8},
+                   {"nm", 3},
+                   {"sd", 1},
+                   {"il", BUFSIZE}
+    };
+    
+    /* Add Objects */
+    Memory tape("tape");
+    Memory acodeInstr("ainstr");
+    Memory scodeInstr("sinstr");
+    MockIO io("io");
+    BfCpu  cpu("cpu", cpuCfg, tape, acodeInstr, scodeInstr, io);
+
+    /* Initialize acodeInstr */
+    std::vector<char> buf(BUFSIZE);
+    buf.assign(BUFSIZE,',');
+    acodeInstr.LoadRaw(buf.data(), BUFSIZE);
+    
+    /* Do simulation */
+    steps_cycles_t res = cpu.Execute(10);
+    TestExpectEqual(0, res.first, "No steps are done without input");
+    TestExpectTrue(cpu.IsWaitingForInput(), "CPU waits for input");
+    TestExpectEqual(0, cpu.GetRegs().cfg["pc"], "PC is not advanced");
+    
+    io.has_data = true;
+    res = cpu.Execute(1);
+    TestExpectEqual(1, res.first, "Input instruction is done");
+    TestExpectTrue(!cpu.IsWaitingForInput(), "CPU does not wait anymore");
+    TestExpectEqual(1, cpu.GetRegs().cfg["pc"], "PC is advanced");
+    TestExpectEqual('x', tape.Read(0), "Input is stored on tape");
+    
+    return 0;
+}
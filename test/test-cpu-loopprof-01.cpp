@@ -0,0 +1,89 @@
+// Unit test to check loop entries, trip histograms and JSON of loop profile
+
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include "expect.h"
+#include "memory.h"
+#include "bofsim.h"
+#include "iodev.h"
+#include "config.h"
+#include "loopprof.h"
+
+#define BUFSIZE 4096
+
+int main() {
+    Configuration cpuCfg;
+    cpuCfg.cfg = { {"tl", 10},
+                   {"tw", 8},
+                   {"nm", 3},
+                   {"sd", 4},
+                   {"il", BUFSIZE}
+    };
+    
+    /* Add Objects */
+    Memory tape("tape");
+    Memory acodeInstr("ainstr");
+    Memory scodeInstr("sinstr");
+    IODev  io("io");
+    BfCpu  cpu("cpu", cpuCfg, tape, acodeInstr, scodeInstr, io);
+    LoopProfiler profiler("loopprof");
+    cpu.AddObserver(profiler);
+
+    /* Outer loop runs twice, the inner one three times per outer 
+     * iteration, the loop at 15 and the one nested in it are skipped, 
+     * the last loop runs once */
+    std::string acode = "++[>+++[-]<-]>>[[-]]+[-]";
+    acodeInstr.LoadRaw(acode.c_str(), acode.size() + 1);
+    
+    /* Do simulation */
+    steps_cycles_t done = cpu.Execute(1000);
+    TestExpectEqual(HaltMode, cpu.GetMode(), "Program is finished");
+    
+    std::ostringstream report;
+    profiler.ReportJson(report);
+    std::string json = report.str();
+    std::cout << json;
+    
+    TestExpectTrue(json.find("\"total_steps\": " + 
+                             std::to_string(done.first)) != std::string::npos,
+                   "All steps are accounted");
+    size_t outer = json.find("\"start\": 2, \"end\": 12, \"entries\": 1, "
+                             "\"iterations\": 2, ");
+    size_t inner = json.find("\"start\": 7, \"end\": 9, \"entries\": 2, "
+                             "\"iterations\": 6, ");
+    size_t skipped = json.find("\"start\": 15, \"end\": null, "
+                               "\"entries\": 1, \"iterations\": 0, ");
+    size_t last = json.find("\"start\": 21, \"end\": 23, \"entries\": 1, "
+                            "\"iterations\": 1, ");
+    TestExpectTrue(outer != std::string::npos, "Outer loop is entered once");
+    TestExpectTrue(inner != std::string::npos, 
+                   "Inner loop is entered on every outer iteration");
+    TestExpectTrue(skipped != std::string::npos, 
+                   "Skipped loop is entered without iterations");
+    TestExpectTrue(last != std::string::npos, "Last loop is entered once");
+    TestExpectTrue(json.find("\"start\": 16") == std::string::npos,
+                   "Loop nested in a skipped one is not entered");
+    TestExpectTrue(json.find("\"inclusive_steps\": 34, "
+                             "\"exclusive_steps\": 16, ", outer) < inner,
+                   "Outer loop steps exclude those of the inner loop");
+    TestExpectTrue(outer < inner, 
+                   "Outer loop includes the inner one and ranks first");
+    
+    /* Trip histogram buckets are 0, 1, 2-3, 4-7, ... */
+    TestExpectTrue(json.find("\"trip_histogram\": [{\"min\": 2, \"max\": 3, "
+                             "\"count\": 1}]", outer) < inner,
+                   "Outer loop makes two trips");
+    TestExpectTrue(json.find("\"trip_histogram\": [{\"min\": 2, \"max\": 3, "
+                             "\"count\": 2}]", inner) != std::string::npos,
+                   "Inner loop makes three trips twice");
+    TestExpectTrue(json.find("\"trip_histogram\": [{\"min\": 0, \"max\": 0, "
+                             "\"count\": 1}]", skipped) != std::string::npos,
+                   "Skipped loop makes zero trips");
+    TestExpectTrue(json.find("\"trip_histogram\": [{\"min\": 1, \"max\": 1, "
+                             "\"count\": 1}]", last) != std::string::npos,
+                   "Last loop makes one trip");
+    
+    return 0;
+}
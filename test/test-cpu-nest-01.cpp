@@ -0,0 +1,57 @@
+// Unit test to check call stack depth limit and return from supervisor mode
+
+#include <exception>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <istream>
+
+#include "expect.h"
+#include "memory.h"
+#include "bofsim.h"
+#include "iodev.h"
+#include "config.h"
+
+#define BUFSIZE 4096
+
+int main() {
+    Configuration cpuCfg;
+    cpuCfg.cfg = { {"tl", 10},
+                   {"tw", 8},
+                   {"nm", 3},
+                   {"sd", 2},
+                   {"il", BUFSIZE}
+    };
+    
+    /* Add Objects */
+    Memory tape("tape");
+    Memory acodeInstr("ainstr");
+    Memory scodeInstr("sinstr");
+    IODev  io("io");
+    BfCpu  cpu("cpu", cpuCfg, tape, acodeInstr, scodeInstr, io);
+
+    /* Third nested loop does not fit into the call stack */
+    std::string acode = "+[[[";
+    acodeInstr.LoadRaw(acode.c_str(), acode.size() + 1);
+    /* Supervisor skips the faulting instruction and returns */
+    std::string scode = std::string(1000, '>') + "+" + 
+                        std::string(1000, '<') + "]";
+    scodeInstr.LoadRaw(scode.c_str(), scode.size() + 1);
+    
+    /* Do simulation */
+    cpu.Execute(3);
+    TestExpectEqual(ApplicationMode, cpu.GetMode(), "Two loops are entered");
+    cpu.Execute(1);
+    TestExpectEqual(SupervisorMode, cpu.GetMode(), 
+                    "Stack overflow is a violation");
+    TestExpectEqual(0, cpu.GetRegs().Get("pc"), "Active PC is reset");
+    
+    cpu.Execute(scode.size());
+    TestExpectEqual(ApplicationMode, cpu.GetMode(), 
+                    "Unmatched ] in supervisor returns");
+    TestExpectEqual(4, cpu.GetRegs().Get("pc"), "Saved PC is restored");
+    TestExpectEqual(0, cpu.GetRegs().Get("tp"), "TP is preserved");
+    TestExpectEqual(1, cpu.SupervisorEntries(), "One supervisor entry");
+    
+    return 0;
+}
@@ -0,0 +1,62 @@
+// Unit test to check that supervisor loops keep the open loops of the 
+// application
+
+#include <exception>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <istream>
+
+#include "expect.h"
+#include "memory.h"
+#include "bofsim.h"
+#include "iodev.h"
+#include "config.h"
+
+#define BUFSIZE 4096
+
+int main() {
+    Configuration cpuCfg;
+    cpuCfg.cfg = { {"tl", 10},
+                   {"tw", 8},
+                   {"nm", 3},
+                   {"sd", 2},
+                   {"il", BUFSIZE}
+    };
+    
+    /* Add Objects */
+    Memory tape("tape");
+    Memory acodeInstr("ainstr");
+    Memory scodeInstr("sinstr");
+    IODev  io("io");
+    BfCpu  cpu("cpu", cpuCfg, tape, acodeInstr, scodeInstr, io);
+
+    /* '<' at TP = 0 inside an open loop traps */
+    std::string acode = "+[<+]";
+    acodeInstr.LoadRaw(acode.c_str(), acode.size() + 1);
+    /* Supervisor skips the faulting instruction, runs a loop of its own 
+     * that clears cell 0 and returns */
+    std::string scode = std::string(1000, '>') + "+" + 
+                        std::string(1000, '<') + "[-]]";
+    scodeInstr.LoadRaw(scode.c_str(), scode.size() + 1);
+    
+    /* Do simulation */
+    cpu.Execute(3);
+    TestExpectEqual(SupervisorMode, cpu.GetMode(), "'<' at TP = 0 traps");
+    TestExpectEqual(0, cpu.GetRegs().Get("sp"), "Supervisor stack is empty");
+    
+    cpu.Execute(scode.size());
+    TestExpectEqual(ApplicationMode, cpu.GetMode(), 
+                    "Unmatched ] in supervisor returns");
+    TestExpectEqual(3, cpu.GetRegs().Get("pc"), 
+                    "Faulting instruction is skipped");
+    TestExpectEqual(1, cpu.GetRegs().Get("sp"), "Application loop is open");
+    TestExpectEqual(1, cpu.CallStack()[0], 
+                    "Application loop start is not overwritten");
+    
+    cpu.Execute(2);
+    TestExpectEqual(1, cpu.GetRegs().Get("pc"), 
+                    "Application ] jumps back to its own [");
+    
+    return 0;
+}
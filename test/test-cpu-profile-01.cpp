@@ -0,0 +1,74 @@
+// Unit test to check per-PC profile counts and loop ranking
+
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include "expect.h"
+#include "memory.h"
+#include "bofsim.h"
+#include "iodev.h"
+#include "config.h"
+#include "profile.h"
+
+#define BUFSIZE 4096
+
+int main() {
+    Configuration cpuCfg;
+    cpuCfg.cfg = { {"tl", 10},
+                   {"tw", 8},
+                   {"nm", 3},
+                   {"sd", 4},
+                   {"il", BUFSIZE}
+    };
+    
+    /* Add Objects */
+    Memory tape("tape");
+    Memory acodeInstr("ainstr");
+    Memory scodeInstr("sinstr");
+    IODev  io("io");
+    BfCpu  cpu("cpu", cpuCfg, tape, acodeInstr, scodeInstr, io);
+    PcProfiler profiler("profiler", BUFSIZE);
+    profiler.Attach(cpu);
+
+    /* Outer loop runs twice, the inner one three times per outer 
+     * iteration, the last loop once */
+    std::string acode = "++[>+++[-]<-]>>+[-]";
+    acodeInstr.LoadRaw(acode.c_str(), acode.size() + 1);
+    
+    /* Do simulation */
+    steps_cycles_t done = cpu.Execute(1000);
+    TestExpectEqual(HaltMode, cpu.GetMode(), "Program is finished");
+    TestExpectEqual(1, profiler.Steps(ApplicationMode, 0), "Once at 0");
+    TestExpectEqual(2, profiler.Steps(ApplicationMode, 2), 
+                    "Outer [ is entered and jumped back to");
+    TestExpectEqual(6, profiler.Steps(ApplicationMode, 8), 
+                    "Inner body runs 2 x 3 times");
+    TestExpectEqual(2, profiler.Steps(ApplicationMode, 12), "Outer ] twice");
+    TestExpectEqual(1, profiler.Steps(ApplicationMode, 17), "Last body once");
+    TestExpectEqual(0, profiler.Steps(SupervisorMode, 0), 
+                    "Supervisor is not run");
+    step_t total = 0;
+    for (address_t pc = 0; pc <= acode.size(); pc++)
+        total += profiler.Steps(ApplicationMode, pc);
+    TestExpectEqual(done.first, total, "Every step is counted");
+    
+    /* Loops are ranked by inclusive steps */
+    std::ostringstream report;
+    profiler.Report(report, acodeInstr, scodeInstr);
+    std::string text = report.str();
+    TestExpectTrue(report.precision() == 6 && 
+                   !(report.flags() & std::ios::fixed),
+                   "Report restores the stream format");
+    size_t loops = text.find("Hottest loops");
+    size_t outer = text.find("app      2     12", loops);
+    size_t inner = text.find("app      7      9", loops);
+    size_t last  = text.find("app     16     18", loops);
+    TestExpectTrue(loops != std::string::npos && outer != std::string::npos 
+                   && inner != std::string::npos && last != std::string::npos,
+                   "All three loops are found");
+    TestExpectTrue(outer < inner && inner < last, 
+                   "Outer loop includes the inner one and ranks first");
+    
+    return 0;
+}
@@ -0,0 +1,87 @@
+// Unit test to check instruction mix, execution results and skipping steps
+// of run statistics
+
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include "expect.h"
+#include "memory.h"
+#include "bofsim.h"
+#include "iodev.h"
+#include "config.h"
+#include "stats.h"
+
+#define BUFSIZE 4096
+
+static bool contains(const std::string &text, const std::string &what) {
+    return text.find(what) != std::string::npos;
+}
+
+int main() {
+    Configuration cpuCfg;
+    cpuCfg.cfg = { {"tl", 10},
+                   {"tw", 8},
+                   {"nm", 3},
+                   {"sd", 4},
+                   {"il", BUFSIZE}
+    };
+    
+    /* Add Objects */
+    Memory tape("tape");
+    Memory acodeInstr("ainstr");
+    Memory scodeInstr("sinstr");
+    IODev  io("io");
+    BfCpu  cpu("cpu", cpuCfg, tape, acodeInstr, scodeInstr, io);
+    RunStats stats("stats");
+    cpu.AddObserver(stats);
+
+    /* The loop at 1 runs once, the one at 4 is skipped together with 
+     * the loop nested in it: 7 steps after its '[' up to and including 
+     * the closing ']' are executed with SK > 0 */
+    std::string acode = "+[-][+[>]-.]+";
+    acodeInstr.LoadRaw(acode.c_str(), acode.size() + 1);
+    
+    /* Stop right after entering skip mode: the '[' itself is not 
+     * executed with SK > 0 */
+    steps_cycles_t done = cpu.Execute(5);
+    TestExpectEqual(5, done.first, "Up to the skipped loop");
+    std::ostringstream entered;
+    stats.Report(entered, cpu, true);
+    TestExpectTrue(contains(entered.str(), "\"skipping_steps\": 0, "), 
+                   "Entering skip mode is not skipping");
+    
+    /* Do simulation */
+    done = cpu.Execute(1000);
+    TestExpectEqual(HaltMode, cpu.GetMode(), "Program is finished");
+    TestExpectEqual(9, done.first, "Every instruction runs once");
+    
+    std::ostringstream report;
+    stats.Report(report, cpu, true);
+    std::string json = report.str();
+    std::cout << json;
+    
+    TestExpectTrue(contains(json, "\"steps\": 14, "), "Steps are counted");
+    TestExpectTrue(contains(json, "\"app_steps\": 14, \"sup_steps\": 0, "),
+                   "Steps are counted by mode");
+    TestExpectTrue(contains(json, "\"skipping_steps\": 7, "), 
+                   "Steps with SK > 0 are counted as skipping");
+    TestExpectTrue(contains(json, "\"opcodes\": {\"<\": 0, \">\": 1, "
+                            "\"+\": 3, \"-\": 2, \".\": 1, \",\": 0, "
+                            "\"[\": 3, \"]\": 3, \"end\": 1, \"nop\": 0}"),
+                   "Skipped instructions are in the mix");
+    TestExpectTrue(contains(json, "\"results\": {\"regular\": 6, "
+                            "\"controlflow\": 0, \"violation\": 0, "
+                            "\"skipping\": 7, \"nop\": 0, \"halt\": 1, "
+                            "\"wouldblock\": 0}"),
+                   "Results are counted");
+    
+    std::ostringstream text;
+    stats.Report(text, cpu);
+    TestExpectTrue(contains(text.str(), "skipping steps     7\n"), 
+                   "Text report has skipping steps");
+    TestExpectTrue(text.precision() == 6 && !(text.flags() & std::ios::fixed),
+                   "Text report restores the stream format");
+    
+    return 0;
+}
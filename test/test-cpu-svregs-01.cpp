@@ -0,0 +1,63 @@
+// Unit test to check supervisor registers mapped into tape space
+
+#include <exception>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <istream>
+
+#include "expect.h"
+#include "memory.h"
+#include "bofsim.h"
+#include "iodev.h"
+#include "config.h"
+
+#define BUFSIZE 4096
+
+/* Output device remembering what was written */
+class MockIO: public SimObject, public IOIface {
+public:
+    std::vector<my_uint128_t> out;
+    MockIO(const std::string _name): SimObject(_name) {};
+    virtual my_uint128_t Read() { return 0; }
+    virtual void Write(my_uint128_t val) { out.push_back(val); }
+};
+
+int main() {
+    Configuration cpuCfg;
+    cpuCfg.cfg = { {"tl", 10},
+                   {"tw", 8},
+                   {"nm", 3},
+                   {"sd", 1},
+                   {"il", BUFSIZE}
+    };
+    
+    /* Add Objects */
+    Memory tape("tape");
+    Memory acodeInstr("ainstr");
+    Memory scodeInstr("sinstr");
+    MockIO io("io");
+    BfCpu  cpu("cpu", cpuCfg, tape, acodeInstr, scodeInstr, io);
+
+    /* Application violates at the end of tape */
+    std::vector<char> buf(BUFSIZE);
+    buf.assign(BUFSIZE,'>');
+    acodeInstr.LoadRaw(buf.data(), BUFSIZE);
+    cpu.SetRegister("tp", 1023);
+    
+    /* Supervisor outputs SR, then increments and outputs saved PC */
+    std::string scode = std::string(1023 - 1001, '<') + ".<+.";
+    scodeInstr.LoadRaw(scode.c_str(), scode.size() + 1);
+    
+    /* Do simulation */
+    cpu.Execute(1);
+    TestExpectEqual(SupervisorMode, cpu.GetMode(), "Supervisor is entered");
+    cpu.Execute(scode.size());
+    TestExpectEqual(2, io.out.size(), "Two values are output");
+    TestExpectEqual(0x1003E, io.out[0], "SR is mapped at 1001");
+    TestExpectEqual(1, io.out[1], "Saved PC is mapped at 1000");
+    TestExpectEqual(0, tape.Read(1000), "Tape at 1000 is not touched");
+    TestExpectEqual(0, tape.Read(1001), "Tape at 1001 is not touched");
+    
+    return 0;
+}
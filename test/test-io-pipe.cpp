@@ -0,0 +1,69 @@
+// Unit test to check IO to a pipe going through vmsplice
+
+#include <exception>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "iodev.h"
+#include "expect.h"
+
+#define OUTSIZE (1024*1024 + 123) // several pipe buffers and a partial one
+
+/* Write OUTSIZE bytes through IODev to a pipe and check what arrives.
+ * A non-blocking pipe with a late reader makes the writer wait for room. */
+void check_pipe(bool nonblocking) {
+    int fds[2];
+    TestExpectTrue(pipe(fds) == 0, "Pipe is created");
+    int pipe_size = fcntl(fds[0], F_GETPIPE_SZ);
+    
+    pid_t pid = fork();
+    TestExpectTrue(pid >= 0, "Fork succeeded");
+    if (pid == 0) { // writer
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+        if (nonblocking)
+            fcntl(STDOUT_FILENO, F_SETFL, 
+                  fcntl(STDOUT_FILENO, F_GETFL) | O_NONBLOCK);
+        {
+            IODev dev("dev");
+            for (size_t i = 0; i < OUTSIZE; i++)
+                dev.Write(i % 251);
+        }
+        _exit(0);
+    }
+    
+    /* Reader: check that everything arrived in order */
+    close(fds[1]);
+    if (nonblocking)
+        usleep(100000);
+    TestExpectEqual(pipe_size, fcntl(fds[0], F_GETPIPE_SZ), 
+                    "Pipe is not resized");
+    std::vector<char> buf(65536);
+    size_t total = 0;
+    bool in_order = true;
+    ssize_t len;
+    while ((len = read(fds[0], buf.data(), buf.size())) > 0) {
+        for (ssize_t i = 0; i < len; i++)
+            in_order = in_order && (buf[i] == (char)((total + i) % 251));
+        total += len;
+    }
+    close(fds[0]);
+    int status = 0;
+    waitpid(pid, &status, 0);
+    TestExpectTrue(WIFEXITED(status) && WEXITSTATUS(status) == 0, 
+                   "Writer exited normally");
+    TestExpectEqual(OUTSIZE, total, "All output arrived");
+    TestExpectTrue(in_order, "Output is not corrupted");
+}
+
+int main() {
+    check_pipe(false);
+    check_pipe(true);
+    return 0;
+}
@@ -0,0 +1,109 @@
+// Unit test to check IO through a shared io_uring and its fallback
+
+#include <exception>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "uringio.h"
+#include "expect.h"
+
+#define OUTSIZE 10000 // more than two buffers
+#define OUTPIPESIZE 65536 // default pipe capacity
+
+static void check_hub(bool use_uring) {
+    int in_fd = open("test-io-stdin", O_RDONLY);
+    int out_fd = open("test-io-uring-stdout", 
+                      O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    int null_fd = open("/dev/null", O_RDWR);
+    TestExpectTrue(in_fd >= 0 && out_fd >= 0 && null_fd >= 0, "Files open");
+    {
+        UringHub hub("hub", 2, 4096, use_uring);
+        UringIODev dev("dev", hub, in_fd, out_fd);
+        UringIODev other("other", hub, null_fd, null_fd);
+        
+        my_uint128_t val = 0;
+        while (!dev.TryRead(val))
+            hub.Wait();
+        TestExpectEqual('a', val, "Input is 'a'");
+        for (size_t i = 0; i < OUTSIZE; i++) {
+            dev.Write(i % 251);
+            other.Write(i);
+            hub.Poll();
+        }
+    } // devices flush on destruction
+    close(in_fd);
+    close(out_fd);
+    close(null_fd);
+    
+    /* Let's check what we just wrote */
+    std::ifstream out("test-io-uring-stdout");
+    char char_val;
+    size_t total = 0;
+    bool in_order = true;
+    while (out.get(char_val)) {
+        in_order = in_order && (char_val == (char)(total % 251));
+        total++;
+    }
+    TestExpectEqual(OUTSIZE, total, "All output is written");
+    TestExpectTrue(in_order, "Output is not corrupted");
+}
+
+/* Non-blocking pipes: reads must not block or end input while the pipe is
+ * empty, writes must wait for a slow reader instead of dropping output */
+static void check_nonblocking(bool use_uring) {
+    int in_pipe[2], out_pipe[2];
+    TestExpectTrue(pipe2(in_pipe, O_NONBLOCK) == 0 && 
+                   pipe2(out_pipe, O_NONBLOCK) == 0, "Pipes open");
+    pid_t reader = fork();
+    if (reader == 0) { // drain the output slowly and check it
+        close(out_pipe[1]);
+        fcntl(out_pipe[0], F_SETFL, 0);
+        usleep(100000);
+        char c;
+        size_t total = 0;
+        bool in_order = true;
+        while (read(out_pipe[0], &c, 1) == 1) {
+            in_order = in_order && c == (char)(total % 251);
+            total++;
+        }
+        _exit(in_order && total == 4 * OUTPIPESIZE ? 0 : 1);
+    }
+    close(out_pipe[0]);
+    {
+        UringHub hub("hub", 1, 4096, use_uring);
+        UringIODev dev("dev", hub, in_pipe[0], out_pipe[1]);
+        
+        my_uint128_t val = 0;
+        TestExpectTrue(!dev.TryRead(val), "Empty pipe has no input");
+        hub.Poll();
+        TestExpectTrue(!dev.TryRead(val), "Empty pipe is not end of input");
+        TestExpectEqual(1, write(in_pipe[1], "b", 1), "Input is sent");
+        while (!dev.TryRead(val))
+            hub.Wait();
+        TestExpectEqual('b', val, "Input is 'b'");
+        
+        for (size_t i = 0; i < 4 * OUTPIPESIZE; i++)
+            dev.Write(i % 251);
+    } // the device waits for the reader on destruction
+    close(out_pipe[1]);
+    close(in_pipe[0]);
+    close(in_pipe[1]);
+    int status = 0;
+    waitpid(reader, &status, 0);
+    TestExpectTrue(WIFEXITED(status) && WEXITSTATUS(status) == 0, 
+                   "All output reaches a slow reader");
+}
+
+int main() {
+    check_hub(true);
+    check_hub(false);
+    check_nonblocking(true);
+    check_nonblocking(false);
+    return 0;
+}
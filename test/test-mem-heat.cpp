@@ -0,0 +1,86 @@
+// Unit test to check tape heatmap counts and working set
+
+#include <string>
+#include <sstream>
+#include <iostream>
+
+#include "expect.h"
+#include "memory.h"
+#include "bofsim.h"
+#include "iodev.h"
+#include "config.h"
+#include "heatmap.h"
+
+#define BUFSIZE 4096
+
+int main() {
+    Configuration cpuCfg;
+    cpuCfg.cfg = { {"tl", 10},
+                   {"tw", 8},
+                   {"nm", 3},
+                   {"sd", 8},
+                   {"il", BUFSIZE}
+    };
+    
+    /* Add Objects */
+    Memory tape("tape");
+    TapeHeatmap heatmap("heatmap", tape, 4, 10);
+    Memory acodeInstr("ainstr");
+    Memory scodeInstr("sinstr");
+    IODev  io("io");
+    BfCpu  cpu("cpu", cpuCfg, heatmap, acodeInstr, scodeInstr, io);
+    cpu.AddObserver(heatmap);
+
+    /* Ten steps stay in cell 0, the next ten only move the pointer */
+    std::string acode = std::string(10, '+') + std::string(10, '>') + "+";
+    acodeInstr.LoadRaw(acode.c_str(), acode.size() + 1);
+    
+    /* Do simulation */
+    cpu.Execute(acode.size());
+    heatmap.Finish();
+    
+    TestExpectEqual(3, heatmap.Intervals(), "Two full and one partial");
+    TestExpectEqual(1, heatmap.WorkingSet(0), "First interval is one block");
+    TestExpectEqual(0, heatmap.WorkingSet(1), "Moving TP touches no cells");
+    TestExpectEqual(1, heatmap.WorkingSet(2), "Last step touches one block");
+    TestExpectEqual(2, heatmap.TotalWorkingSet(), "Whole run is two blocks");
+    TestExpectEqual(10, tape.Read(0), "Heatmap forwards writes to tape");
+    TestExpectEqual(1, tape.Read(10), "Heatmap forwards writes to tape");
+    
+    std::ostringstream csv;
+    heatmap.ReportCsv(csv);
+    std::string header = csv.str().substr(0, csv.str().find('\n'));
+    TestExpectEqual(1, header == "interval,first_step,reads,writes,"
+                                 "working_set_blocks,working_set_bytes,"
+                                 "block_0,block_8", 
+                    "CSV header lists touched blocks");
+    
+    /* Loaded cells count as written */
+    std::ostringstream loaded_csv;
+    heatmap.LoadRaw("\1\2\3\4\5\6", 6);
+    heatmap.Finish();
+    heatmap.ReportCsv(loaded_csv);
+    TestExpectTrue(loaded_csv.str().find("\n3,21,0,6,2,8,") != 
+                   std::string::npos, "Load writes two blocks");
+    TestExpectEqual(6, tape.Read(5), "Heatmap forwards loads to tape");
+    
+    /* At most four intervals are kept, neighbours are merged */
+    Memory tape2("tape2");
+    TapeHeatmap merged("merged", tape2, 4, 10, 4);
+    Memory acode2("ainstr2");
+    BfCpu  cpu2("cpu2", cpuCfg, merged, acode2, scodeInstr, io);
+    cpu2.AddObserver(merged);
+    std::string acode2text = std::string(20, '+') + std::string(20, '>') 
+                             + std::string(10, '+');
+    acode2.LoadRaw(acode2text.c_str(), acode2text.size() + 1);
+    cpu2.Execute(acode2text.size());
+    merged.Finish();
+    TestExpectEqual(3, merged.Intervals(), "Four merged into two, partial");
+    TestExpectEqual(20, merged.Span(), "Merged intervals are twice longer");
+    TestExpectEqual(1, merged.WorkingSet(0), "Steps 1-20 touch one block");
+    TestExpectEqual(0, merged.WorkingSet(1), "Steps 21-40 touch none");
+    TestExpectEqual(1, merged.WorkingSet(2), "Steps 41-50 touch one block");
+    TestExpectTrue(merged.HostBytes() > 0, "Heatmap holds memory");
+    
+    return 0;
+}
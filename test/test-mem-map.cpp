@@ -0,0 +1,72 @@
+// Unit test to check address map and bulk I/O device
+
+#include <exception>
+#include <string>
+#include <iostream>
+#include <fstream>
+
+#include "memory.h"
+#include "addrmap.h"
+#include "bulkio.h"
+#include "expect.h"
+
+int main() {
+    Memory ram("ram");
+    AddressMap map("map", ram);
+    BulkIODev bulk("bulk", ram, 2048, "test-mem-map-bulk");
+    map.AddMapping(bulk, 1024, BulkIODev::Count);
+    
+    /* Plain memory around the mapping */
+    map.Write(1023, 'a');
+    map.Write(1024 + BulkIODev::Count, 'b');
+    TestExpectEqual('a', ram.Read(1023), "Below the mapping is memory");
+    TestExpectEqual('b', ram.Read(1024 + BulkIODev::Count), 
+                    "Above the mapping is memory");
+    
+    /* Store 5 cells at 10 to the file */
+    std::string hello("hello");
+    ram.LoadRaw(("0123456789" + hello).c_str(), 15);
+    map.Write(1024 + BulkIODev::Addr, 10);
+    map.Write(1024 + BulkIODev::Len, 5);
+    map.Write(1024 + BulkIODev::Cmd, BulkIODev::CmdStore);
+    TestExpectEqual(0, map.Read(1024 + BulkIODev::Status), "Store is done");
+    TestExpectEqual(5, map.Read(1024 + BulkIODev::Pos), "Position advanced");
+    TestExpectEqual(0, ram.Read(1024 + BulkIODev::Cmd), 
+                    "Memory under the mapping is not touched");
+    
+    /* Load them back at 1 */
+    map.Write(1024 + BulkIODev::Addr, 1);
+    map.Write(1024 + BulkIODev::Pos, 0);
+    map.Write(1024 + BulkIODev::Cmd, BulkIODev::CmdLoad);
+    TestExpectEqual(0, map.Read(1024 + BulkIODev::Status), "Load is done");
+    for (size_t i = 0; i < hello.size(); i++)
+        TestExpectEqual(hello[i], ram.Read(1 + i), "Loaded cell matches");
+    
+    /* Past the end of file */
+    map.Write(1024 + BulkIODev::Cmd, BulkIODev::CmdLoad);
+    TestExpectEqual(1, map.Read(1024 + BulkIODev::Status), "Load fails");
+    
+    /* Past the end of tape, nothing is allocated or written */
+    map.Write(1024 + BulkIODev::Addr + 0, 0xff);
+    map.Write(1024 + BulkIODev::Addr + 1, 0x07);
+    map.Write(1024 + BulkIODev::Len, 2);
+    map.Write(1024 + BulkIODev::Pos, 0);
+    map.Write(1024 + BulkIODev::Cmd, BulkIODev::CmdStore);
+    TestExpectEqual(1, map.Read(1024 + BulkIODev::Status), 
+                    "Store beyond tape length fails");
+    map.Write(1024 + BulkIODev::Addr + 0, 0);
+    map.Write(1024 + BulkIODev::Addr + 1, 0);
+    map.Write(1024 + BulkIODev::Len + 3, 0xff);
+    map.Write(1024 + BulkIODev::Cmd, BulkIODev::CmdLoad);
+    TestExpectEqual(1, map.Read(1024 + BulkIODev::Status), 
+                    "Huge length fails");
+    map.Write(1024 + BulkIODev::Len + 3, 0);
+    for (int i = 0; i < 4; i++)
+        map.Write(1024 + BulkIODev::Pos + i, 0xff);
+    map.Write(1024 + BulkIODev::Cmd, BulkIODev::CmdStore);
+    TestExpectEqual(1, map.Read(1024 + BulkIODev::Status), 
+                    "Position overflow fails");
+    TestExpectEqual(0, ram.Size() > 2048, "Tape did not grow");
+    
+    return 0;
+}
@@ -0,0 +1,34 @@
+// Unit test to check trace ring buffer
+
+#include <exception>
+#include <string>
+#include <iostream>
+#include <fstream>
+
+#include "trace.h"
+#include "expect.h"
+
+int main() {
+    TraceBuffer trace("trace", "test-trace-out", 4);
+    step_record_t rec = {};
+    for (uint64_t i = 1; i <= 6; i++) {
+        rec.step = i;
+        rec.pc = 10 * i;
+        trace.OnStep(rec);
+    }
+    trace.Dump();
+    
+    /* Let's check what we just wrote */
+    std::ifstream in("test-trace-out", std::ios::binary);
+    trace_header_t hdr;
+    in.read((char*)&hdr, sizeof(hdr));
+    TestExpectEqual(4, hdr.count, "Ring capacity is kept");
+    TestExpectEqual(2, hdr.lost, "Oldest records are lost");
+    for (uint64_t i = 3; i <= 6; i++) {
+        in.read((char*)&rec, sizeof(rec));
+        TestExpectEqual(i, rec.step, "Records are oldest first");
+        TestExpectEqual(10 * i, rec.pc, "Record is intact");
+    }
+    TestExpectTrue((bool)in, "Trace is complete");
+    return 0;
+}
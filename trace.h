@@ -0,0 +1,113 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <fstream>
+#include <cstring>
+
+#include "inttypes.h"
+#include "object.h"
+#include "bofsim.h"
+#include "log.h"
+
+/* Header of a binary trace file, followed by records oldest first */
+struct trace_header_t {
+    char magic[8];        // "BFTRACE"
+    uint32_t version;
+    uint32_t record_size; // sizeof(step_record_t)
+    uint64_t count;       // records in file
+    uint64_t lost;        // older records overwritten in the ring
+};
+
+static const char trace_magic[8] = "BFTRACE";
+static const uint32_t trace_version = 1;
+
+/* Last steps of execution kept in a ring of binary records. Recording is
+ * a copy of the record, formatting is left to bofsim-trace. */
+class TraceBuffer: public SimObject, public ExecutionObserverIface, 
+                   public FootprintIface {
+    std::vector<step_record_t> ring;
+    uint64_t mask;
+    uint64_t head; // records ever written
+    std::string filename;
+    bool dump_on_violation;
+    
+public:
+    /* IN: capacity - records to keep, rounded up to a power of two */
+    TraceBuffer(const std::string _name, const std::string &_filename, 
+                size_t capacity, bool _dump_on_violation = false):
+        SimObject(_name), ring(), mask(0), head(0), 
+        filename(_filename), dump_on_violation(_dump_on_violation)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+        ring.resize(size);
+        mask = size - 1;
+    }
+    
+    virtual size_t HostBytes() const {
+        return ring.capacity() * sizeof(step_record_t);
+    }
+    
+    virtual void OnStep(const step_record_t &rec) {
+        ring[head++ & mask] = rec;
+        if (rec.result == (uint8_t)ExecuteResult::Halt ||
+            (dump_on_violation && 
+             rec.result == (uint8_t)ExecuteResult::Violation))
+            Dump();
+    }
+    
+    /* Write ring contents to the trace file, may be called at any time */
+    void Dump() {
+        trace_header_t hdr;
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, trace_magic, sizeof(hdr.magic));
+        hdr.version = trace_version;
+        hdr.record_size = sizeof(step_record_t);
+        hdr.count = head < ring.size() ? head : ring.size();
+        hdr.lost = head - hdr.count;
+        
+        std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+        out.write((const char*)&hdr, sizeof(hdr));
+        uint64_t first = head - hdr.count;
+        size_t start = first & mask;
+        size_t tail = std::min<size_t>(hdr.count, ring.size() - start);
+        out.write((const char*)&ring[start], tail * sizeof(step_record_t));
+        out.write((const char*)&ring[0], 
+                  (hdr.count - tail) * sizeof(step_record_t));
+        if (!out)
+            info(1, std::string("Cannot write trace to ") + filename);
+    }
+};
+
+#endif // TRACE_H_
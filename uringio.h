@@ -0,0 +1,554 @@
+/* Copyright (c) 2014, Grigory Rechistov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without modification,
+are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, 
+this list of conditions and the following disclaimer.
+
+2. Redistributions in binary form must reproduce the above copyright notice, 
+this list of conditions and the following disclaimer in the documentation 
+and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, 
+THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, 
+OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; 
+OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, 
+WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR 
+OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, 
+EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+
+#ifndef URINGIO_H_
+#define URINGIO_H_
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "inttypes.h"
+#include "object.h"
+#include "iodev.h"
+#include "log.h"
+
+/* Completion receiver for UringHub operations. A transient -EAGAIN or
+ * -EINTR result is for the client to queue again with when_ready set */
+class UringClientIface {
+public:
+    virtual void ReadDone(ssize_t res) = 0;
+    virtual void WriteDone(ssize_t res) = 0;
+};
+
+/* One io_uring shared by all guests of a process. Devices queue their reads
+ * and writes here; the host submits everything queued with one Poll() or
+ * Wait() call and gets all completions reaped in a batch. Device buffers are
+ * slots of one page-aligned arena registered with the kernel, so that
+ * READ_FIXED/WRITE_FIXED avoid mapping user pages per request.
+ * If io_uring is not available, operations are done in place with plain
+ * read()/write() on the same buffers once poll() says the descriptor is
+ * ready; until then they wait in the hub, so queueing never blocks.
+ */
+class UringHub: public SimObject {
+    /* Ring */
+    int ring_fd;
+    bool fixed_bufs; // arena is registered
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_cqe *cqes;
+    unsigned sq_entries;
+    unsigned pending; // queued but not yet submitted
+    unsigned inflight; // submitted but not yet completed
+    
+    /* Buffers */
+    char *arena;
+    size_t slot_size;
+    unsigned slot_count;
+    std::vector<unsigned> free_slots;
+    
+    /* Clients by id. Ids are not reused so that a late completion
+     * cannot reach a wrong client */
+    std::unordered_map<uint32_t, UringClientIface*> clients;
+    uint32_t next_id;
+    
+    /* Fallback operations whose descriptor is not ready yet */
+    struct deferred_t {
+        uint64_t tag;
+        int fd;
+        char *buf;
+        size_t len;
+        bool write;
+    };
+    std::vector<deferred_t> deferred;
+    
+    /* Completions of readiness polls linked before a retried operation */
+    static const uint32_t poll_id = 0xffffffff;
+    
+    static uint64_t Tag(uint32_t id, unsigned slot, bool write) {
+        return ((uint64_t)id << 32) | ((uint64_t)slot << 1) | write;
+    }
+    
+    void SetupRing(unsigned entries) {
+        struct io_uring_params p;
+        memset(&p, 0, sizeof(p));
+        int fd = syscall(__NR_io_uring_setup, entries, &p);
+        if (fd < 0) {
+            info(2, "io_uring is not available, using read/write");
+            return;
+        }
+        if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+            // Needed to use pipes, terminals and files at current offset
+            info(2, "io_uring is too old, using read/write");
+            close(fd);
+            return;
+        }
+        sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        if (p.features & IORING_FEAT_SINGLE_MMAP)
+            sq_size = cq_size = std::max(sq_size, cq_size);
+        sq_ptr = mmap(nullptr, sq_size, PROT_READ | PROT_WRITE, 
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sq_ptr == MAP_FAILED) {
+            close(fd);
+            return;
+        }
+        if (p.features & IORING_FEAT_SINGLE_MMAP) {
+            cq_ptr = sq_ptr;
+        } else {
+            cq_ptr = mmap(nullptr, cq_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+            if (cq_ptr == MAP_FAILED) {
+                munmap(sq_ptr, sq_size);
+                close(fd);
+                return;
+            }
+        }
+        sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+        sqes = (struct io_uring_sqe*)mmap(nullptr, sqes_size, 
+                                          PROT_READ | PROT_WRITE, 
+                                          MAP_SHARED | MAP_POPULATE, 
+                                          fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) {
+            if (cq_ptr != sq_ptr) munmap(cq_ptr, cq_size);
+            munmap(sq_ptr, sq_size);
+            close(fd);
+            return;
+        }
+        char *sq = (char*)sq_ptr, *cq = (char*)cq_ptr;
+        sq_head  = (unsigned*)(sq + p.sq_off.head);
+        sq_tail  = (unsigned*)(sq + p.sq_off.tail);
+        sq_mask  = (unsigned*)(sq + p.sq_off.ring_mask);
+        sq_array = (unsigned*)(sq + p.sq_off.array);
+        cq_head  = (unsigned*)(cq + p.cq_off.head);
+        cq_tail  = (unsigned*)(cq + p.cq_off.tail);
+        cq_mask  = (unsigned*)(cq + p.cq_off.ring_mask);
+        cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+        sq_entries = p.sq_entries;
+        ring_fd = fd;
+        
+        std::vector<struct iovec> iov(slot_count);
+        for (unsigned i = 0; i < slot_count; i++) {
+            iov[i].iov_base = arena + i * slot_size;
+            iov[i].iov_len = slot_size;
+        }
+        fixed_bufs = syscall(__NR_io_uring_register, ring_fd, 
+                             IORING_REGISTER_BUFFERS, 
+                             iov.data(), slot_count) == 0;
+        if (!fixed_bufs)
+            info(2, "Cannot register io_uring buffers, using plain ops");
+    }
+    
+    struct io_uring_sqe* GetSqe() {
+        unsigned tail = *sq_tail;
+        if (tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE) >= sq_entries) {
+            Submit(0);
+            Reap();
+        }
+        unsigned idx = tail & *sq_mask;
+        struct io_uring_sqe *sqe = &sqes[idx];
+        memset(sqe, 0, sizeof(*sqe));
+        sq_array[idx] = idx;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+        pending++;
+        return sqe;
+    }
+    
+    /* Fallback: do the operation if its descriptor is ready.
+     * RETURN: false if it would block and has to wait */
+    bool TryInPlace(const deferred_t &op) {
+        struct pollfd pfd = {};
+        pfd.fd = op.fd;
+        pfd.events = op.write ? POLLOUT : POLLIN;
+        int ready;
+        do {
+            ready = poll(&pfd, 1, 0);
+        } while (ready < 0 && errno == EINTR);
+        if (ready == 0)
+            return false;
+        ssize_t res;
+        do {
+            res = op.write ? ::write(op.fd, op.buf, op.len)
+                           : ::read(op.fd, op.buf, op.len);
+        } while (res < 0 && errno == EINTR);
+        if (res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return false;
+        Complete(op.tag, res < 0 ? -errno : res);
+        return true;
+    }
+    
+    /* Fallback: retry operations waiting for their descriptors, 
+     * IN: wait - block until at least one of them is ready */
+    void RunDeferred(bool wait) {
+        if (deferred.empty())
+            return;
+        if (wait) {
+            std::vector<struct pollfd> pfds(deferred.size());
+            for (size_t i = 0; i < deferred.size(); i++) {
+                pfds[i].fd = deferred[i].fd;
+                pfds[i].events = deferred[i].write ? POLLOUT : POLLIN;
+            }
+            while (poll(pfds.data(), pfds.size(), -1) < 0 && errno == EINTR)
+                ;
+        }
+        std::vector<deferred_t> ops;
+        ops.swap(deferred); // completions may defer new operations
+        for (auto &op: ops)
+            if (!TryInPlace(op))
+                deferred.push_back(op);
+    }
+    
+    void Queue(uint32_t id, int fd, unsigned slot, size_t offset, 
+               size_t len, bool write, bool when_ready) {
+        if (ring_fd < 0) { // synchronous fallback
+            deferred_t op = {Tag(id, slot, write), fd, 
+                             arena + slot * slot_size + offset, len, write};
+            if (!TryInPlace(op))
+                deferred.push_back(op);
+            return;
+        }
+        if (when_ready) { // the operation runs once the poll completes
+            struct io_uring_sqe *poll_sqe = GetSqe();
+            poll_sqe->opcode = IORING_OP_POLL_ADD;
+            poll_sqe->fd = fd;
+            poll_sqe->poll_events = write ? POLLOUT : POLLIN;
+            poll_sqe->flags = IOSQE_IO_LINK;
+            poll_sqe->user_data = Tag(poll_id, 0, false);
+        }
+        struct io_uring_sqe *sqe = GetSqe();
+        if (fixed_bufs) {
+            sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+            sqe->buf_index = slot;
+        } else {
+            sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+        }
+        sqe->fd = fd;
+        sqe->off = (uint64_t)-1; // current file position
+        sqe->addr = (uint64_t)(arena + slot * slot_size + offset);
+        sqe->len = len;
+        sqe->user_data = Tag(id, slot, write);
+    }
+    
+    void Complete(uint64_t tag, ssize_t res) {
+        uint32_t id = tag >> 32;
+        if (id == poll_id) // the linked operation completes on its own
+            return;
+        auto it = clients.find(id);
+        if (it == clients.end()) { // client is gone, its buffer is free now
+            free_slots.push_back((tag & 0xffffffff) >> 1);
+            return;
+        }
+        if (tag & 1)
+            it->second->WriteDone(res);
+        else
+            it->second->ReadDone(res);
+    }
+    
+    void Submit(unsigned wait_nr) {
+        if (ring_fd < 0 || (!pending && !wait_nr))
+            return;
+        int flags = wait_nr ? IORING_ENTER_GETEVENTS : 0;
+        int res;
+        do {
+            res = syscall(__NR_io_uring_enter, ring_fd, pending, wait_nr, 
+                          flags, nullptr, 0);
+        } while (res < 0 && errno == EINTR);
+        if (res < 0)
+            error("io_uring_enter failed");
+        pending -= res;
+        inflight += res;
+    }
+    
+    void Reap() {
+        if (ring_fd < 0)
+            return;
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            struct io_uring_cqe cqe = cqes[head & *cq_mask];
+            head++;
+            __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+            inflight--;
+            Complete(cqe.user_data, cqe.res); // may queue more operations
+            tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        }
+    }
+
+public:
+    /* IN: max_clients - number of devices to serve at once, 
+           slot_size - bytes per buffer, each device uses three buffers
+           use_uring - false forces read/write fallback */
+    UringHub(const std::string _name, unsigned max_clients = 64,
+             size_t _slot_size = 4096, bool use_uring = true): 
+        SimObject(_name),
+        ring_fd(-1), fixed_bufs(false),
+        sq_ptr(nullptr), cq_ptr(nullptr), sq_size(0), cq_size(0),
+        sqes(nullptr), sqes_size(0),
+        sq_head(nullptr), sq_tail(nullptr), sq_mask(nullptr), 
+        sq_array(nullptr), cq_head(nullptr), cq_tail(nullptr), 
+        cq_mask(nullptr), cqes(nullptr),
+        sq_entries(0), pending(0), inflight(0),
+        arena(nullptr), slot_size(_slot_size), slot_count(3 * max_clients),
+        free_slots(), clients(), next_id(0)
+    {
+        void *mem = nullptr;
+        if (slot_count == 0 || 
+            posix_memalign(&mem, sysconf(_SC_PAGESIZE), slot_count * slot_size))
+            error("Cannot allocate I/O buffers");
+        arena = (char*)mem;
+        for (unsigned i = slot_count; i > 0; i--)
+            free_slots.push_back(i - 1);
+        if (use_uring) {
+            unsigned entries = 1;
+            while (entries < 2 * max_clients && entries < 4096)
+                entries <<= 1;
+            SetupRing(entries);
+        }
+    }
+    
+    virtual ~UringHub() {
+        if (ring_fd >= 0) {
+            /* Devices flush their output when destroyed, so only reads 
+             * waiting for input may be left. Closing the ring cancels them. */
+            munmap(sqes, sqes_size);
+            if (cq_ptr != sq_ptr) munmap(cq_ptr, cq_size);
+            munmap(sq_ptr, sq_size);
+            close(ring_fd);
+        }
+        free(arena);
+    }
+    
+    bool UsesUring() const { return ring_fd >= 0; }
+    bool UsesFixedBuffers() const { return fixed_bufs; }
+    size_t SlotSize() const { return slot_size; }
+    char* SlotData(unsigned slot) { return arena + slot * slot_size; }
+    
+    uint32_t Attach(UringClientIface *client) {
+        clients[next_id] = client;
+        return next_id++;
+    }
+    void Detach(uint32_t id) {
+        clients.erase(id);
+        for (size_t i = 0; i < deferred.size(); ) { // these never complete
+            if ((deferred[i].tag >> 32) == id) {
+                free_slots.push_back((deferred[i].tag & 0xffffffff) >> 1);
+                deferred.erase(deferred.begin() + i);
+            } else {
+                i++;
+            }
+        }
+    }
+    
+    unsigned AllocSlot() {
+        if (free_slots.empty())
+            error("Too many I/O devices for the hub");
+        unsigned slot = free_slots.back();
+        free_slots.pop_back();
+        return slot;
+    }
+    void FreeSlot(unsigned slot) { free_slots.push_back(slot); }
+    
+    /* IN: when_ready - wait for the descriptor to get ready first, 
+           for operations that failed with -EAGAIN */
+    void QueueRead(uint32_t id, int fd, unsigned slot, size_t len, 
+                   bool when_ready = false) {
+        Queue(id, fd, slot, 0, len, false, when_ready);
+    }
+    void QueueWrite(uint32_t id, int fd, unsigned slot, 
+                    size_t offset, size_t len, bool when_ready = false) {
+        Queue(id, fd, slot, offset, len, true, when_ready);
+    }
+    
+    /* Submit everything queued by all clients in one system call and
+     * dispatch whatever has completed, do not wait */
+    void Poll() {
+        Submit(0);
+        Reap();
+        RunDeferred(false);
+    }
+    
+    /* Same as Poll() but waits for at least one completion if anything 
+     * is in flight */
+    void Wait() {
+        Submit(inflight + pending ? 1 : 0);
+        Reap();
+        RunDeferred(true);
+    }
+};
+
+/* Guest I/O device doing its transfers through a shared UringHub. 
+ * Output is double-buffered: one buffer is filled while the other one
+ * is being written. Input is read ahead a buffer at a time. 
+ * TryRead() does not block; the host gets the data in with 
+ * UringHub::Poll() or UringHub::Wait().
+ */
+class UringIODev: public SimObject, public IOIface, public UringClientIface {
+    UringHub &hub;
+    uint32_t id;
+    int in_fd, out_fd;
+    
+    unsigned out_slot[2];
+    int active;       // output buffer being filled
+    size_t out_fill;
+    bool write_inflight;
+    unsigned write_slot;
+    size_t write_done, write_len;
+    
+    unsigned in_slot;
+    size_t in_pos, in_len;
+    bool read_inflight;
+    bool in_eof;
+    
+    void StartWrite() {
+        if (!out_fill)
+            return;
+        while (write_inflight) // keep writes to one descriptor in order
+            hub.Wait();
+        write_slot = out_slot[active];
+        write_done = 0;
+        write_len = out_fill;
+        write_inflight = true;
+        active ^= 1;
+        out_fill = 0;
+        hub.QueueWrite(id, out_fd, write_slot, 0, write_len);
+    }
+
+public:
+    UringIODev(const std::string _name, UringHub &_hub, 
+               int _in_fd = 0, int _out_fd = 1): 
+        SimObject(_name),
+        hub(_hub),
+        id(hub.Attach(this)),
+        in_fd(_in_fd), out_fd(_out_fd),
+        active(0), out_fill(0), write_inflight(false),
+        write_slot(0), write_done(0), write_len(0),
+        in_pos(0), in_len(0), read_inflight(false), in_eof(false)
+    {
+        out_slot[0] = hub.AllocSlot();
+        out_slot[1] = hub.AllocSlot();
+        in_slot = hub.AllocSlot();
+    }
+    
+    virtual ~UringIODev() {
+        try {
+            Flush();
+        } catch (std::exception &) {} // already reported
+        hub.Detach(id);
+        hub.FreeSlot(out_slot[0]);
+        hub.FreeSlot(out_slot[1]);
+        if (!read_inflight) // otherwise the hub frees it on completion
+            hub.FreeSlot(in_slot);
+    }
+    
+    virtual my_uint128_t Read() {
+        my_uint128_t val;
+        while (!TryRead(val))
+            hub.Wait();
+        return val;
+    }
+    
+    virtual bool TryRead(my_uint128_t &val) {
+        if (in_pos < in_len) {
+            val = hub.SlotData(in_slot)[in_pos++];
+            return true;
+        }
+        if (in_eof) {
+            val = 0;
+            return true;
+        }
+        if (!read_inflight) {
+            StartWrite(); // let an interactive user see the prompt
+            read_inflight = true;
+            hub.QueueRead(id, in_fd, in_slot, hub.SlotSize());
+            if (!read_inflight) // done in place by the fallback
+                return TryRead(val);
+        }
+        return false;
+    }
+    
+    virtual void Write(my_uint128_t val) {
+        hub.SlotData(out_slot[active])[out_fill++] = static_cast<char>(val);
+        if (out_fill == hub.SlotSize())
+            StartWrite();
+    }
+    
+    virtual void Flush() {
+        StartWrite();
+        while (write_inflight)
+            hub.Wait();
+    }
+    
+    /* UringClientIface implementation */
+    virtual void ReadDone(ssize_t res) {
+        if (res == -EAGAIN || res == -EINTR) { // no input yet, ask again
+            hub.QueueRead(id, in_fd, in_slot, hub.SlotSize(), true);
+            return;
+        }
+        if (res < 0)
+            info(1, std::string("Reading input failed, treated as end of it: ")
+                    + strerror(-res));
+        read_inflight = false;
+        in_pos = 0;
+        in_len = res > 0 ? res : 0;
+        in_eof = res <= 0;
+    }
+    
+    virtual void WriteDone(ssize_t res) {
+        if (res == -EAGAIN || res == -EINTR) { // output is full, send again
+            hub.QueueWrite(id, out_fd, write_slot, write_done, 
+                           write_len - write_done, true);
+            return;
+        }
+        if (res <= 0) {
+            write_inflight = false;
+            error(std::string("Writing output failed: ") + 
+                  (res < 0 ? strerror(-res) : "nothing written"));
+        }
+        write_done += res;
+        if (write_done < write_len) // short write, send the rest
+            hub.QueueWrite(id, out_fd, write_slot, write_done, 
+                           write_len - write_done);
+        else
+            write_inflight = false;
+    }
+};
+
+#endif // URINGIO_H_